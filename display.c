@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stdio.h>
 #include "temp_control.h"
 #include "fix_point.h"
 #include "tick.h"
@@ -52,6 +53,42 @@ static void fix_to_str(char *buf, int16_t val)
         buf[0] = '-';
 }
 
+static void display_autotune(const struct autotune *tune)
+{
+    char buf[17];
+
+    lcd_set_position(0, 0);
+    lcd_puts_P(PSTR("Autotune:"));
+
+    lcd_set_position(1, 1);
+    switch (tune->state)
+    {
+        case AUTOTUNE_RUNNING:
+            snprintf_P(buf, sizeof(buf), PSTR("Cycle %u of %u"),
+                    tune->cycles + 1, AUTOTUNE_CYCLES);
+            lcd_puts(buf);
+            break;
+        case AUTOTUNE_DONE:
+            lcd_puts_P(PSTR("Ku"));
+            fix_to_str(buf, tune->ku);
+            lcd_puts(buf);
+            snprintf_P(buf, sizeof(buf), PSTR(" Tu %us"), tune->period);
+            lcd_puts(buf);
+
+            lcd_set_position(2, 1);
+            lcd_puts_P(PSTR("Kp"));
+            fix_to_str(buf, tune->gains.kp);
+            lcd_puts(buf);
+            lcd_puts_P(PSTR(" Kd"));
+            fix_to_str(buf, tune->gains.kd);
+            lcd_puts(buf);
+            break;
+        default:
+            lcd_puts_P(PSTR("Failed"));
+            break;
+    }
+}
+
 void display_init(void)
 {
     lcd_init();
@@ -63,14 +100,22 @@ void display_update(void)
 {
     static uint32_t last_switch_tick = 0;
     static uint8_t sensor_num = 0;
+    const struct autotune *tune = temp_control_get_autotune();
     struct temp_sensor *sensor;
+    uint8_t pages = temp_control_get_num_sensors();
+    uint8_t zone;
+    int16_t min, max;
     char buf[5];
 
+    // autotune progress or result after the sensor pages
+    if (tune->state != AUTOTUNE_OFF)
+        pages++;
+
     if (tick_get() - last_switch_tick >= LCD_SWITCH_INTERVAL)
     {
         last_switch_tick += LCD_SWITCH_INTERVAL;
 
-        if (++sensor_num >= temp_control_get_num_sensors())
+        if (++sensor_num >= pages)
             sensor_num = 0;
     }
 
@@ -78,6 +123,13 @@ void display_update(void)
 
     lcd_clear();
 
+    if (sensor == NULL && tune->state != AUTOTUNE_OFF)
+    {
+        display_autotune(tune);
+
+        return;
+    }
+
     if (sensor == NULL)
     {
         lcd_set_position(0, 0);
@@ -90,26 +142,41 @@ void display_update(void)
     lcd_puts(sensor->name);
     lcd_putc(':');
 
+    if (!sensor->online)
+        lcd_puts_P(PSTR(" off"));
+
     lcd_set_position(1, 1);
+    // extremes over the long statistics window
     lcd_puts_P(PSTR("Cur  Min  Max"));
 
     lcd_set_position(2, 1);
     fix_to_str(buf, sensor->temp);
     lcd_puts(buf);
     lcd_set_position(2, 6);
-    fix_to_str(buf, sensor->min);
-    lcd_puts(buf);
-    lcd_set_position(2, 11);
-    fix_to_str(buf, sensor->max);
-    lcd_puts(buf);
+    if (stats_get_min_max(temp_control_get_stats(sensor_num),
+                STATS_NUM_WINDOWS - 1, &min, &max))
+    {
+        fix_to_str(buf, min);
+        lcd_puts(buf);
+        lcd_set_position(2, 11);
+        fix_to_str(buf, max);
+        lcd_puts(buf);
+    }
+
+    // setpoint and state of the zone controlled by this sensor
+    zone = temp_control_get_sensor_zone(sensor_num);
+    if (zone == NO_ZONE)
+        return;
 
     lcd_set_position(3, 0);
-    lcd_puts_P(PSTR("SP: "));
-    fix_to_str(buf, temp_control_get_target_temp());
+    lcd_puts_P(PSTR("SP"));
+    lcd_putc('1' + zone);
+    lcd_putc(':');
+    fix_to_str(buf, temp_control_get_target_temp(zone));
     lcd_puts(buf);
 
     lcd_set_position(3, 11);
-    switch (temp_control_get_state())
+    switch (temp_control_get_state(zone))
     {
         case STOPPED:
             lcd_puts_P(PSTR("Stop"));
@@ -61,6 +61,26 @@ changelog:
 #define DS18X20_COPYSP_DELAY      10 /* ms */
 
 
+// state of the asynchronous scratchpad reads, one per bus
+static uint8_t async_sp[OW_NUM_BUSES][DS18X20_SP_SIZE];
+static const uint8_t *async_id[OW_NUM_BUSES];
+static int16_t *async_val[OW_NUM_BUSES];
+static uint8_t async_ret[OW_NUM_BUSES];
+static uint8_t async_queued;
+
+
+
+/* check whether a rom-code found by a search belongs to a temp sensor */
+bool DS18X20_is_sensor(const uint8_t *id)
+{
+    if (id[0] != DS18B20_FAMILY_CODE &&
+        id[0] != DS18S20_FAMILY_CODE &&
+        id[0] != DS1822_FAMILY_CODE)
+        return false;
+
+    // check crc
+    return (ow_crc8(id, OW_ROMCODE_SIZE - 1) == id[OW_ROMCODE_SIZE - 1]);
+}
 
 /* find DS18X20 Sensors on 1-Wire-Bus
    input/ouput: diff is the result of the last rom-search
@@ -71,15 +91,8 @@ bool DS18X20_find_sensor(uint8_t *id)
     // search devices on bus
     while (ow_search_rom(id))
     {
-        // check whether device is a temp sensor
-        if (id[0] == DS18B20_FAMILY_CODE ||
-            id[0] == DS18S20_FAMILY_CODE ||
-            id[0] == DS1822_FAMILY_CODE)
-        {
-            // check crc
-            if (ow_crc8(id, OW_ROMCODE_SIZE - 1) == id[OW_ROMCODE_SIZE - 1])
-                return true;
-        }
+        if (DS18X20_is_sensor(id))
+            return true;
     }
 
     return false;
@@ -116,65 +129,68 @@ bool DS18X20_conversion_in_progress(void)
     return (!ow_read_bit());
 }
 
-uint8_t DS18X20_read_fixed_point(const uint8_t *id, int16_t *val)
+static int16_t DS18X20_sp_to_fixed_point(const uint8_t *id, const uint8_t *sp)
 {
-    uint8_t sp[DS18X20_SP_SIZE];
-    uint8_t ret;
+    int16_t raw_val;
+    uint8_t family_code = DS18B20_FAMILY_CODE;
 
-    ret = DS18X20_read_scratchpad(id, sp);
+    if (id != NULL)
+        family_code = id[0];
 
-    if (ret == DS18X20_OK)
+    raw_val = sp[0] | (sp[1] << 8);
+
+    if (family_code == DS18S20_FAMILY_CODE)
+    {
+        // 9 -> 12 bit if 18S20
+        /* Extended measurements for DS18S20 contributed by Carsten Foss */
+        // Discard LSB, needed for later extended precicion calc
+        raw_val &= (uint16_t)0xfffe;
+        // Convert to 12-bit, now degrees are in 1/16 degrees units
+        raw_val <<= 3;
+        // Add the compensation and remember to subtract 0.25 degree (4/16)
+        raw_val += (sp[7] - sp[6]) - 4;
+    }
+    else if (family_code == DS18B20_FAMILY_CODE ||
+             family_code == DS1822_FAMILY_CODE )
     {
-        int16_t raw_val;
-        uint8_t family_code = DS18B20_FAMILY_CODE;
+        // clear undefined bits for DS18B20 != 12bit resolution
+        switch (sp[DS18B20_CONF_REG] & DS18B20_RES_MASK)
+        {
+        case DS18B20_9_BIT:
+            raw_val &= ~(DS18B20_9_BIT_UNDF);
+            break;
+        case DS18B20_10_BIT:
+            raw_val &= ~(DS18B20_10_BIT_UNDF);
+            break;
+        case DS18B20_11_BIT:
+            raw_val &= ~(DS18B20_11_BIT_UNDF);
+            break;
+        default:
+            // 12 bit - all bits valid
+            break;
+        }
+    }
 
-        if (id != NULL)
-            family_code = id[0];
+    // check for negative 
+    if (raw_val & 0x8000)
+    {
+        // convert from twos complement to machine representation
+        // should compile to nop on twos complement machines
+        raw_val = -((~raw_val) + 1);
+    }
 
-        raw_val = sp[0] | (sp[1] << 8);
+    return INT_TO_FIX(raw_val) / 16;
+}
 
-        if (family_code == DS18S20_FAMILY_CODE)
-        {
-            // 9 -> 12 bit if 18S20
-            /* Extended measurements for DS18S20 contributed by Carsten Foss */
-            // Discard LSB, needed for later extended precicion calc
-            raw_val &= (uint16_t)0xfffe;
-            // Convert to 12-bit, now degrees are in 1/16 degrees units
-            raw_val <<= 3;
-            // Add the compensation and remember to subtract 0.25 degree (4/16)
-            raw_val += (sp[7] - sp[6]) - 4;
-        }
-        else if (family_code == DS18B20_FAMILY_CODE ||
-                 family_code == DS1822_FAMILY_CODE )
-        {
-            // clear undefined bits for DS18B20 != 12bit resolution
-            switch (sp[DS18B20_CONF_REG] & DS18B20_RES_MASK)
-            {
-            case DS18B20_9_BIT:
-                raw_val &= ~(DS18B20_9_BIT_UNDF);
-                break;
-            case DS18B20_10_BIT:
-                raw_val &= ~(DS18B20_10_BIT_UNDF);
-                break;
-            case DS18B20_11_BIT:
-                raw_val &= ~(DS18B20_11_BIT_UNDF);
-                break;
-            default:
-                // 12 bit - all bits valid
-                break;
-            }
-        }
+uint8_t DS18X20_read_fixed_point(const uint8_t *id, int16_t *val)
+{
+    uint8_t sp[DS18X20_SP_SIZE];
+    uint8_t ret;
 
-        // check for negative 
-        if (raw_val & 0x8000)
-        {
-            // convert from twos complement to machine representation
-            // should compile to nop on twos complement machines
-            raw_val = -((~raw_val) + 1);
-        }
+    ret = DS18X20_read_scratchpad(id, sp);
 
-        *val = INT_TO_FIX(raw_val) / 16;
-    }
+    if (ret == DS18X20_OK)
+        *val = DS18X20_sp_to_fixed_point(id, sp);
 
     return ret;
 }
@@ -241,3 +257,138 @@ uint8_t DS18X20_eeprom_to_scratchpad(const uint8_t *id)
     return DS18X20_OK;
 }
 
+
+// true if the conversion resolution can be configured
+bool DS18X20_resolution_supported(const uint8_t *id)
+{
+    return (id[0] == DS18B20_FAMILY_CODE || id[0] == DS1822_FAMILY_CODE);
+}
+
+/* conversion time in ms for the resolution in conf
+   (DS18B20_9_BIT..DS18B20_12_BIT, ignored on DS18S20) */
+uint16_t DS18X20_conversion_time(const uint8_t *id, uint8_t conf)
+{
+    if (!DS18X20_resolution_supported(id))
+        return DS18S20_TCONV;
+
+    switch (conf & DS18B20_RES_MASK)
+    {
+    case DS18B20_9_BIT:
+        return DS18B20_TCONV_9BIT;
+    case DS18B20_10_BIT:
+        return DS18B20_TCONV_10BIT;
+    case DS18B20_11_BIT:
+        return DS18B20_TCONV_11BIT;
+    default:
+        return DS18B20_TCONV_12BIT;
+    }
+}
+
+/* start measurement without waiting for the 1-Wire transfer,
+   completion is reported by DS18X20_async_poll(). With bus == OW_ALL_BUSES
+   and id == NULL all sensors on all buses are started at once. */
+uint8_t DS18X20_start_meas_async(uint8_t bus, const uint8_t *id)
+{
+    if (async_queued != 0 ||
+            !ow_async_start(bus, DS18X20_CONVERT_T, id, NULL, 0, NULL, 0))
+        return DS18X20_START_FAIL;
+
+    return DS18X20_OK;
+}
+
+/* write th, tl (and conf on DS18B20/DS1822) without waiting, only the
+   scratchpad is written so the alarm flag follows from the next conversion */
+uint8_t DS18X20_write_scratchpad_async(uint8_t bus, const uint8_t *id,
+        uint8_t th, uint8_t tl, uint8_t conf)
+{
+    uint8_t tx[3] = { th, tl, conf };
+    uint8_t len = 2;
+
+    if (id[0] == DS18B20_FAMILY_CODE || id[0] == DS1822_FAMILY_CODE)
+        len = 3;
+
+    if (async_queued != 0 || !ow_async_start(bus, DS18X20_WRITE_SCRATCHPAD,
+                id, tx, len, NULL, 0))
+        return DS18X20_START_FAIL;
+
+    return DS18X20_OK;
+}
+
+/* queue a scratchpad read, *val is updated by DS18X20_async_poll() once
+   the transfer completed with a valid crc. Reads queued on different buses
+   are transferred in parallel by DS18X20_async_run(). */
+uint8_t DS18X20_read_fixed_point_async(uint8_t bus, const uint8_t *id,
+        int16_t *val)
+{
+    if (async_queued == 0 &&
+            !ow_async_begin(DS18X20_READ_SCRATCHPAD, NULL, 0, DS18X20_SP_SIZE))
+        return DS18X20_START_FAIL;
+
+    if (!ow_async_add(bus, id, async_sp[bus]))
+        return DS18X20_START_FAIL;
+
+    async_id[bus] = id;
+    async_val[bus] = val;
+    async_ret[bus] = DS18X20_ERROR;
+    async_queued |= _BV(bus);
+
+    return DS18X20_OK;
+}
+
+uint8_t DS18X20_async_run(void)
+{
+    if (!ow_async_run())
+    {
+        async_queued = 0;
+        return DS18X20_START_FAIL;
+    }
+
+    return DS18X20_OK;
+}
+
+// returns DS18X20_BUSY while a transfer is in flight
+uint8_t DS18X20_async_poll(void)
+{
+    uint8_t bus, failed, ret = DS18X20_OK;
+
+    switch (ow_async_poll())
+    {
+        case OW_ASYNC_BUSY:
+            return DS18X20_BUSY;
+        case OW_ASYNC_ERROR:
+            ret = DS18X20_ERROR;
+            break;
+        default:
+            break;
+    }
+
+    failed = ow_async_failed_buses();
+
+    for (bus = 0; bus < OW_NUM_BUSES; bus++)
+    {
+        uint8_t *sp = async_sp[bus];
+
+        if (!(async_queued & _BV(bus)) || (failed & _BV(bus)))
+            continue;
+
+        if (ow_crc8(sp, DS18X20_SP_SIZE - 1) != sp[DS18X20_SP_SIZE - 1])
+        {
+            async_ret[bus] = ret = DS18X20_ERROR_CRC;
+        }
+        else
+        {
+            *async_val[bus] = DS18X20_sp_to_fixed_point(async_id[bus], sp);
+            async_ret[bus] = DS18X20_OK;
+        }
+    }
+
+    async_queued = 0;
+
+    return ret;
+}
+
+// result of the last read on bus
+uint8_t DS18X20_async_result(uint8_t bus)
+{
+    return async_ret[bus];
+}
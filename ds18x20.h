@@ -11,6 +11,7 @@
 #define DS18X20_ERROR             0x01
 #define DS18X20_START_FAIL        0x02
 #define DS18X20_ERROR_CRC         0x03
+#define DS18X20_BUSY              0x04
 
 /* DS18X20 specific values (see datasheet) */
 #define DS18B20_CONF_REG          4
@@ -35,6 +36,7 @@
 #define DS18X20_TL_REG            3
 
 
+bool DS18X20_is_sensor(const uint8_t *id);
 bool DS18X20_find_sensor(uint8_t *id);
 bool DS18X20_parasite_powered(const uint8_t *id);
 uint8_t DS18X20_start_meas(const uint8_t *id);
@@ -54,5 +56,19 @@ uint8_t DS18X20_scratchpad_to_eeprom(const uint8_t *id);
 // copy values from DS18x20 eeprom into scratchpad
 uint8_t DS18X20_eeprom_to_scratchpad(const uint8_t *id);
 
+bool DS18X20_resolution_supported(const uint8_t *id);
+uint16_t DS18X20_conversion_time(const uint8_t *id, uint8_t conf);
+
+// non-blocking variants, one transfer at a time, reads on different
+// buses are combined into one parallel transfer
+uint8_t DS18X20_start_meas_async(uint8_t bus, const uint8_t *id);
+uint8_t DS18X20_read_fixed_point_async(uint8_t bus, const uint8_t *id,
+        int16_t *val);
+uint8_t DS18X20_write_scratchpad_async(uint8_t bus, const uint8_t *id,
+        uint8_t th, uint8_t tl, uint8_t conf);
+uint8_t DS18X20_async_run(void);
+uint8_t DS18X20_async_poll(void);
+uint8_t DS18X20_async_result(uint8_t bus);
+
 
 #endif
@@ -1,6 +1,11 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "fan_control.h"
+#include "fix_point.h"
+#include "tick.h"
 
 #define PWM_FREQ 25000UL
 #define PWM_CLOCKS ((F_CPU + (PWM_FREQ / 2)) / PWM_FREQ)
@@ -12,14 +17,60 @@
 #endif
 
 #define PWM_TOP (PWM_CLOCKS - 1)
-//#define PWM_HIGH (PWM_CLOCKS)
-#define PWM_HIGH (PWM_CLOCKS / 2)
-#define PWM_LOW (PWM_CLOCKS / 50)
 
-#if (PWM_LOW < 1)
-#undef PWM_LOW
-#define PWM_LOW 1
-#endif
+// duty cycles of fan_control_set_on()
+#define FAN_ON_DUTY 50
+#define FAN_OFF_DUTY 2
+
+// tach input on PD7 (PCINT31), 2 pulses per revolution
+#define FAN_TACH_PULSES 2
+#define FAN_RPM_INTERVAL (1000 / TICK_MS)
+
+// closed loop: duty change of 1/FAN_RPM_GAIN_DIV percent per rpm error and
+// second, larger errors than a full duty swing are clamped
+#define FAN_RPM_GAIN_DIV 200
+#define FAN_RPM_MAX_ERROR (100L * FAN_RPM_GAIN_DIV)
+// lowest duty used by the rpm loop while the fan should turn
+#define FAN_MIN_DUTY 10
+
+// no tach pulses for this many intervals while driven above the stall duty
+#define FAN_STALL_DUTY 20
+#define FAN_STALL_INTERVALS 3
+
+static volatile uint16_t tach_pulses;
+static uint32_t rpm_tick;
+static uint16_t rpm;
+static uint8_t duty;
+static uint16_t target_rpm;     // 0: open loop duty
+static int16_t loop_duty;       // closed loop duty in percent, fixed point
+static uint16_t on_rpm;
+static uint8_t stall_intervals;
+static bool stalled;
+static uint16_t stall_count;
+
+ISR(PCINT3_vect)
+{
+    // count falling edges
+    if (!(PIND & _BV(PD7)))
+        tach_pulses++;
+}
+
+static void fan_control_write_duty(uint8_t percent)
+{
+    if (percent == 0)
+    {
+        // a compare value of 0 still leaves a spike each period
+        TCCR2A &= ~_BV(COM2B1);
+        PORTD &= ~_BV(PD6);
+    }
+    else
+    {
+        OCR2B = ((uint16_t) PWM_TOP * percent + 50) / 100;
+        TCCR2A |= _BV(COM2B1);
+    }
+
+    duty = percent;
+}
 
 void fan_control_init(void)
 {
@@ -30,7 +81,7 @@ void fan_control_init(void)
     // set frequency
     OCR2A = PWM_TOP;
     // initially off
-    OCR2B = PWM_LOW;
+    fan_control_write_duty(FAN_OFF_DUTY);
     // reset counter
     TCNT2 = 0;
 #ifdef PRESCALE_8
@@ -42,12 +93,164 @@ void fan_control_init(void)
 #endif
     // enable pin output
     DDRD |= _BV(DDD6);
+
+    // tach input with pullup, pin change interrupt
+    DDRD &= ~_BV(DDD7);
+    PORTD |= _BV(PD7);
+    PCMSK3 |= _BV(PCINT31);
+    PCICR |= _BV(PCIE3);
+    rpm_tick = tick_get();
+}
+
+// open loop duty cycle in percent, ends rpm control
+void fan_control_set_duty(uint8_t percent)
+{
+    if (percent > 100)
+        percent = 100;
+
+    target_rpm = 0;
+    fan_control_write_duty(percent);
+}
+
+// closed loop speed, 0 stops the fan
+void fan_control_set_rpm(uint16_t rpm_target)
+{
+    if (rpm_target == 0)
+    {
+        fan_control_set_duty(0);
+        return;
+    }
+
+    // continue from the current duty
+    if (target_rpm == 0)
+        loop_duty = INT_TO_FIX(duty);
+
+    target_rpm = rpm_target;
+}
+
+/* speed used by fan_control_set_on() and fan_control_set_level(), 0 uses
+   fixed duty cycles */
+void fan_control_set_on_rpm(uint16_t rpm_on)
+{
+    on_rpm = rpm_on;
+}
+
+uint16_t fan_control_get_on_rpm(void)
+{
+    return on_rpm;
 }
 
 void fan_control_set_on(bool on)
 {
-    if (on)
-        OCR2B = PWM_HIGH;
+    if (!on)
+        fan_control_set_duty(FAN_OFF_DUTY);
+    else if (on_rpm != 0)
+        fan_control_set_rpm(on_rpm);
+    else
+        fan_control_set_duty(FAN_ON_DUTY);
+}
+
+// proportional output in percent of the on speed (or of full duty)
+void fan_control_set_level(uint8_t percent)
+{
+    if (percent > 100)
+        percent = 100;
+
+    if (on_rpm != 0)
+        fan_control_set_rpm((uint32_t) on_rpm * percent / 100);
     else
-        OCR2B = PWM_LOW;
+        fan_control_set_duty(percent);
+}
+
+// measure the speed and run the rpm loop, called from the main loop
+void fan_control_update(void)
+{
+    uint32_t now = tick_get();
+    uint16_t pulses;
+    int32_t next;
+
+    if ((now - rpm_tick) < FAN_RPM_INTERVAL)
+        return;
+
+    rpm_tick = now;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pulses = tach_pulses;
+        tach_pulses = 0;
+    }
+
+    rpm = (uint32_t) pulses * 60 * 1000 /
+        ((uint32_t) FAN_TACH_PULSES * FAN_RPM_INTERVAL * TICK_MS);
+
+    if (rpm == 0 && duty >= FAN_STALL_DUTY)
+    {
+        if (stall_intervals < FAN_STALL_INTERVALS &&
+                ++stall_intervals == FAN_STALL_INTERVALS)
+        {
+            stalled = true;
+            stall_count++;
+        }
+    }
+    else
+    {
+        stall_intervals = 0;
+
+        if (rpm != 0)
+            stalled = false;
+    }
+
+    if (target_rpm == 0)
+        return;
+
+    if (stalled)
+    {
+        // full power to get a stuck fan going again
+        loop_duty = INT_TO_FIX(100);
+    }
+    else
+    {
+        int32_t error = (int32_t) target_rpm - rpm;
+
+        if (error > FAN_RPM_MAX_ERROR)
+            error = FAN_RPM_MAX_ERROR;
+        else if (error < -FAN_RPM_MAX_ERROR)
+            error = -FAN_RPM_MAX_ERROR;
+
+        next = loop_duty + error * FIX_ONE / FAN_RPM_GAIN_DIV;
+
+        if (next < INT_TO_FIX(FAN_MIN_DUTY))
+            next = INT_TO_FIX(FAN_MIN_DUTY);
+        else if (next > INT_TO_FIX(100))
+            next = INT_TO_FIX(100);
+
+        loop_duty = next;
+    }
+
+    fan_control_write_duty(FIX_TO_NEAREST_INT(loop_duty));
+}
+
+uint8_t fan_control_get_duty(void)
+{
+    return duty;
+}
+
+uint16_t fan_control_get_rpm(void)
+{
+    return rpm;
+}
+
+uint16_t fan_control_get_target_rpm(void)
+{
+    return target_rpm;
+}
+
+bool fan_control_get_stalled(void)
+{
+    return stalled;
+}
+
+uint16_t fan_control_get_stall_count(void)
+{
+    return stall_count;
 }
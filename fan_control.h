@@ -1,9 +1,21 @@
 #ifndef _FAN_CONTROL_H_
 #define _FAN_CONTROL_H_
 
+#include <stdint.h>
 #include <stdbool.h>
 
 void fan_control_init(void);
 void fan_control_set_on(bool on);
+void fan_control_set_duty(uint8_t percent);
+void fan_control_set_rpm(uint16_t rpm_target);
+void fan_control_set_on_rpm(uint16_t rpm_on);
+uint16_t fan_control_get_on_rpm(void);
+void fan_control_set_level(uint8_t percent);
+void fan_control_update(void);
+uint8_t fan_control_get_duty(void);
+uint16_t fan_control_get_rpm(void);
+uint16_t fan_control_get_target_rpm(void);
+bool fan_control_get_stalled(void);
+uint16_t fan_control_get_stall_count(void);
 
 #endif /* _FAN_CONTROL_H_ */
@@ -0,0 +1,73 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "heater_control.h"
+
+// slow PWM for the solid state relays on PB1 to PB4: 100 steps of 10ms
+#define HEATER_STEP_FREQ 100UL
+#define HEATER_STEPS 100
+#define HEATER_CLOCKS ((F_CPU + (HEATER_STEP_FREQ * 1024 / 2)) / \
+        (HEATER_STEP_FREQ * 1024))
+
+#if HEATER_CLOCKS > 256
+#error "heater step frequency too low for timer 0"
+#endif
+
+#define HEATER_PIN(channel) _BV(PB1 + (channel))
+#define HEATER_MASK (((1 << HEATER_CHANNELS) - 1) << PB1)
+
+static volatile uint8_t level[HEATER_CHANNELS];
+static uint8_t step;
+
+ISR(TIMER0_COMPA_vect)
+{
+    uint8_t on = 0;
+    uint8_t i;
+
+    if (++step >= HEATER_STEPS)
+        step = 0;
+
+    for (i = 0; i < HEATER_CHANNELS; i++)
+    {
+        if (step < level[i])
+            on |= HEATER_PIN(i);
+    }
+
+    PORTB = (PORTB & ~HEATER_MASK) | on;
+}
+
+void heater_control_init(void)
+{
+    // outputs low before the pins are driven
+    PORTB &= ~HEATER_MASK;
+    DDRB |= HEATER_MASK;
+
+    // CTC mode, TOP = OCR0A, div 1024 prescaler
+    TCCR0A = _BV(WGM01);
+    TCCR0B = 0;
+    OCR0A = HEATER_CLOCKS - 1;
+    TCNT0 = 0;
+    TIMSK0 = _BV(OCIE0A);
+    TCCR0B = _BV(CS02) | _BV(CS00);
+}
+
+// share of every 1s window a relay is on, in percent
+void heater_control_set_level(uint8_t channel, uint8_t percent)
+{
+    if (channel >= HEATER_CHANNELS)
+        return;
+
+    if (percent > HEATER_STEPS)
+        percent = HEATER_STEPS;
+
+    level[channel] = percent;
+}
+
+uint8_t heater_control_get_level(uint8_t channel)
+{
+    if (channel >= HEATER_CHANNELS)
+        return 0;
+
+    return level[channel];
+}
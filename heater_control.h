@@ -0,0 +1,14 @@
+#ifndef _HEATER_CONTROL_H_
+#define _HEATER_CONTROL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// solid state relays on PB1 to PB4, for heaters or cooling relays
+#define HEATER_CHANNELS 4
+
+void heater_control_init(void);
+void heater_control_set_level(uint8_t channel, uint8_t percent);
+uint8_t heater_control_get_level(uint8_t channel);
+
+#endif /* _HEATER_CONTROL_H_ */
@@ -0,0 +1,248 @@
+#include <string.h>
+#include "history.h"
+#include "temp_control.h"
+#include "tick.h"
+
+#define TICKS_PER_S (1000 / TICK_MS)
+
+#define NO_GAP 0xFF
+// largest gap count that still fits a single varint byte
+#define MAX_SHORT_GAP 63
+
+// readings older than this are counted as missing, in ticks
+#define MAX_READING_AGE (2UL * MAX_SAMPLE_PERIOD / TICK_MS)
+
+// raw intervals per record of each tier
+static const uint8_t tier_steps[HISTORY_TIERS] = {
+    1,
+    60 / HISTORY_RAW_INTERVAL,
+    900 / HISTORY_RAW_INTERVAL,
+};
+
+struct tier_sum
+{
+    int32_t sum;
+    uint8_t count;
+};
+
+struct sensor_history
+{
+    struct history_ring rings[HISTORY_TIERS];
+    struct tier_sum sums[HISTORY_TIERS];
+};
+
+static struct sensor_history histories[MAX_TEMP_SENSORS];
+
+static uint32_t second_tick;
+static uint8_t seconds;                 // into the current raw interval
+static uint8_t steps[HISTORY_TIERS];    // raw intervals since the last record
+
+static uint8_t ring_index(const struct history_ring *ring, uint8_t offset)
+{
+    uint16_t index = (uint16_t) ring->head + offset;
+
+    if (index >= HISTORY_RING_SIZE)
+        index -= HISTORY_RING_SIZE;
+
+    return index;
+}
+
+// drop the oldest record, its delta moves into the base value
+static void drop_oldest(struct history_ring *ring)
+{
+    uint32_t record = 0;
+    uint8_t byte, shift = 0;
+
+    do
+    {
+        byte = ring->data[ring->head];
+        record |= (uint32_t) (byte & 0x7F) << shift;
+        shift += 7;
+
+        ring->head = ring_index(ring, 1);
+        ring->len--;
+        ring->start++;
+    } while ((byte & 0x80) && ring->len != 0);
+
+    if (!(record & 1))
+    {
+        uint16_t zigzag = record >> 1;
+
+        ring->base += (int16_t) ((zigzag >> 1) ^ -(zigzag & 1));
+    }
+
+    if (ring->len == 0)
+        ring->gap = NO_GAP;
+}
+
+static void push_record(struct history_ring *ring, uint32_t record)
+{
+    uint8_t bytes[3], i, n = 0;
+
+    do
+    {
+        bytes[n] = record & 0x7F;
+        record >>= 7;
+
+        if (record != 0)
+            bytes[n] |= 0x80;
+
+        n++;
+    } while (record != 0);
+
+    while (HISTORY_RING_SIZE - ring->len < n)
+        drop_oldest(ring);
+
+    for (i = 0; i < n; i++)
+        ring->data[ring_index(ring, ring->len++)] = bytes[i];
+}
+
+static void push_value(struct history_ring *ring, int16_t value)
+{
+    int16_t delta = value - ring->last;
+    uint16_t zigzag = ((uint16_t) delta << 1) ^ (uint16_t) (delta >> 15);
+
+    ring->last = value;
+    ring->gap = NO_GAP;
+    push_record(ring, (uint32_t) zigzag << 1);
+}
+
+// consecutive missing intervals share one record
+static void push_gap(struct history_ring *ring)
+{
+    if (ring->gap != NO_GAP && ring->data[ring->gap] < ((MAX_SHORT_GAP << 1) | 1))
+    {
+        ring->data[ring->gap] += 2;
+        return;
+    }
+
+    push_record(ring, (1 << 1) | 1);
+    ring->gap = ring_index(ring, ring->len - 1);
+}
+
+static bool reading_valid(const struct temp_sensor *sensor, uint32_t now)
+{
+    return sensor->online && sensor->sample_tick != 0 &&
+        (now - sensor->sample_tick) <= MAX_READING_AGE;
+}
+
+// add the current readings and close the tier intervals that ended
+static void sample(void)
+{
+    uint32_t now = tick_get();
+    uint8_t i, t, num_sensors = temp_control_get_num_sensors();
+
+    for (i = 0; i < num_sensors; i++)
+    {
+        const struct temp_sensor *sensor = temp_control_get_sensor_data(i);
+        struct sensor_history *history = &histories[i];
+        bool valid = reading_valid(sensor, now);
+
+        for (t = 0; t < HISTORY_TIERS; t++)
+        {
+            struct tier_sum *sum = &history->sums[t];
+
+            if (valid)
+            {
+                sum->sum += sensor->temp >> HISTORY_SHIFT;
+                sum->count++;
+            }
+
+            if (steps[t] + 1 < tier_steps[t])
+                continue;
+
+            if (sum->count != 0)
+                push_value(&history->rings[t], sum->sum / sum->count);
+            else
+                push_gap(&history->rings[t]);
+
+            sum->sum = 0;
+            sum->count = 0;
+        }
+    }
+
+    for (t = 0; t < HISTORY_TIERS; t++)
+    {
+        if (++steps[t] >= tier_steps[t])
+            steps[t] = 0;
+    }
+}
+
+void history_update(void)
+{
+    while (tick_get() - second_tick >= TICKS_PER_S)
+    {
+        second_tick += TICKS_PER_S;
+
+        if (++seconds >= HISTORY_RAW_INTERVAL)
+        {
+            seconds = 0;
+            sample();
+        }
+    }
+}
+
+// forget the history of a sensor slot, e.g. after a new sensor took it
+void history_reset(uint8_t sensor)
+{
+    uint8_t t;
+
+    memset(&histories[sensor], 0, sizeof(histories[sensor]));
+
+    for (t = 0; t < HISTORY_TIERS; t++)
+        histories[sensor].rings[t].gap = NO_GAP;
+}
+
+// the history follows the sensors when their slots are exchanged
+void history_swap(uint8_t a, uint8_t b)
+{
+    uint8_t *pa = (uint8_t *) &histories[a];
+    uint8_t *pb = (uint8_t *) &histories[b];
+    uint16_t i;
+
+    for (i = 0; i < sizeof(struct sensor_history); i++)
+    {
+        uint8_t tmp = pa[i];
+
+        pa[i] = pb[i];
+        pb[i] = tmp;
+    }
+}
+
+const struct history_ring * history_get(uint8_t sensor, uint8_t tier)
+{
+    return &histories[sensor].rings[tier];
+}
+
+// length of a record interval in s
+uint16_t history_get_interval(uint8_t tier)
+{
+    return (uint16_t) tier_steps[tier] * HISTORY_RAW_INTERVAL;
+}
+
+// s since the newest record of a tier was added
+uint16_t history_get_age(uint8_t tier)
+{
+    return (uint16_t) steps[tier] * HISTORY_RAW_INTERVAL + seconds;
+}
+
+/* copy up to size bytes from stream position pos on, returns the number
+   of bytes copied, 0 if pos is no longer or not yet in the ring */
+uint8_t history_read(const struct history_ring *ring, uint32_t pos,
+        uint8_t *buf, uint8_t size)
+{
+    uint8_t i, offset;
+
+    if (pos < ring->start || pos - ring->start >= ring->len)
+        return 0;
+
+    offset = pos - ring->start;
+
+    if (size > ring->len - offset)
+        size = ring->len - offset;
+
+    for (i = 0; i < size; i++)
+        buf[i] = ring->data[ring_index(ring, offset + i)];
+
+    return size;
+}
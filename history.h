@@ -0,0 +1,46 @@
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Per sensor history in three tiers: a sample every HISTORY_RAW_INTERVAL
+   s, the mean of every minute and the mean of every quarter hour. The
+   oldest records of a tier are dropped when its ring is full.
+
+   A tier is a stream of varints (7 bits per byte, lsb first, bit 7 set
+   on all but the last byte) with one record per interval:
+     (zigzag(delta) << 1) | 0   value, delta to the previous value
+     (count << 1) | 1           count intervals without readings
+   The values are in 1/16 degrees, the first delta of the ring is to the
+   base value reported with it. Byte positions count from the start of
+   the stream, so a reader can continue where it stopped. A trailing gap
+   record grows in place while the sensor stays silent. */
+#define HISTORY_TIERS 3
+#define HISTORY_RAW_INTERVAL 10
+#define HISTORY_RING_SIZE 96
+
+// value shift between the fixed point readings and the history
+#define HISTORY_SHIFT 4
+
+struct history_ring
+{
+    uint8_t data[HISTORY_RING_SIZE];
+    uint8_t head;           // oldest byte
+    uint8_t len;
+    uint8_t gap;            // offset of a trailing one byte gap record
+    int16_t base;           // value before the oldest record
+    int16_t last;           // value of the newest value record
+    uint32_t start;         // stream position of head, bytes dropped so far
+};
+
+void history_update(void);
+void history_reset(uint8_t sensor);
+void history_swap(uint8_t a, uint8_t b);
+const struct history_ring * history_get(uint8_t sensor, uint8_t tier);
+uint16_t history_get_interval(uint8_t tier);
+uint16_t history_get_age(uint8_t tier);
+uint8_t history_read(const struct history_ring *ring, uint32_t pos,
+        uint8_t *buf, uint8_t size);
+
+#endif /* _HISTORY_H_ */
@@ -10,6 +10,10 @@
 #include "fix_point.h"
 #include "tick.h"
 #include "rpc.h"
+#include "settings.h"
+#include "fan_control.h"
+#include "profile.h"
+#include "history.h"
 
 
 FUSES = 
@@ -21,6 +25,8 @@ FUSES =
 
 int main(void)
 {
+    uint8_t i;
+
     /* enable all pullups to prevent floating inputs */
     PORTA = 0xFF;
     PORTB = 0xFF;
@@ -32,6 +38,7 @@ int main(void)
 
     tick_init();
     display_init();
+    settings_load();
     temp_control_init();
     rpc_init();
 
@@ -40,12 +47,13 @@ int main(void)
         lcd_clear();
         lcd_set_position(0, 0);
         lcd_puts_P(PSTR("No Sensors Found"));
-        while (true);
     }
 
-    temp_control_set_target_sensor(0);
-    temp_control_set_target_temp(FLOAT_TO_FIX(21));
-    temp_control_set_running(true);
+    /* setpoints come from eeprom or a resumed profile */
+    profile_init();
+
+    for (i = 0; i < MAX_ZONES; i++)
+        temp_control_set_running(i, true);
 
     /* main loop */
     while (1)
@@ -55,7 +63,14 @@ int main(void)
         new_temps = temp_control_update();
 
         if (new_temps)
+        {
             display_update();
+            rpc_push_readings();
+        }
+
+        fan_control_update();
+        profile_update();
+        history_update();
 
         rpc_process_message();
     }
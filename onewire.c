@@ -8,10 +8,12 @@ modified by Martin Thomas (mthomas(at)rhrk.uni-kl.de)
           use of atomic.h macros, internal pull-up support
  7/2010 - added method to skip recovery time after last bit transfered
           via ow_command_skip_last_recovery
+          asynchronous transaction engine and USART bus master backend
 */
 
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include <util/delay.h>
 #include <util/atomic.h>
 #include <util/crc16.h>
@@ -24,7 +26,8 @@ modified by Martin Thomas (mthomas(at)rhrk.uni-kl.de)
 /* Hardware connection                     */
 /*******************************************/
 
-#define OW_PIN  PD5
+// one pin per bus (OW_NUM_BUSES in onewire.h), all on the same port
+#define OW_PINS { _BV(PD5) }
 #define OW_IN   PIND
 #define OW_OUT  PORTD
 #define OW_DDR  DDRD
@@ -48,49 +51,549 @@ modified by Martin Thomas (mthomas(at)rhrk.uni-kl.de)
 #define OW_MATCH_ROM    0x55
 #define OW_SKIP_ROM     0xCC
 #define OW_SEARCH_ROM   0xF0
+#define OW_ALARM_SEARCH 0xEC
 
 #define OW_SEARCH_FIRST 0xFF        // start new search
 #define OW_LAST_DEVICE  0x00        // last device found
 
-#define OW_GET_IN()   (OW_IN & (1<<OW_PIN))
-#define OW_OUT_LOW()  (OW_OUT &= (~(1 << OW_PIN)))
-#define OW_OUT_HIGH() (OW_OUT |= (1 << OW_PIN))
-#define OW_DIR_IN()   (OW_DDR &= (~(1 << OW_PIN)))
-#define OW_DIR_OUT()  (OW_DDR |= (1 << OW_PIN))
+#if OW_USE_USART
+
+#if OW_NUM_BUSES > 1
+#error "the USART backend drives a single bus"
+#endif
+
+// 9600 baud for the reset pulse, 115200 baud for one bit per frame
+#define OW_UBRR(baud) ((F_CPU + 8UL * (baud)) / (16UL * (baud)) - 1)
+#define OW_UBRR_RESET OW_UBRR(9600)
+#define OW_UBRR_SLOT  OW_UBRR(115200)
+
+#define OW_USART_RESET 0xF0
+#define OW_USART_SLOT_0 0x00
+#define OW_USART_SLOT_1 0xFF
+
+#else
+
+// timer 1 runs without prescaler for the asynchronous engine
+#define OW_US_TO_TICKS(us) ((uint16_t) (((F_CPU / 1000UL) * (us)) / 1000UL))
+
+// all macros work on a mask of bus pins
+#define OW_GET_IN(mask)   (OW_IN & (mask))
+#define OW_OUT_LOW(mask)  (OW_OUT &= ~(mask))
+#define OW_OUT_HIGH(mask) (OW_OUT |= (mask))
+#define OW_DIR_IN(mask)   (OW_DDR &= ~(mask))
+#define OW_DIR_OUT(mask)  (OW_DDR |= (mask))
+
+#endif
+
+typedef enum ow_async_state_t
+{
+    ASYNC_RESET_RELEASE,
+    ASYNC_RESET_SAMPLE,
+    ASYNC_RESET_END,
+    ASYNC_SLOT_START,
+    ASYNC_SLOT_END,
+} ow_async_state_t;
+
+#if OW_USE_USART
+// the USART echo is reported as bit 0 of the sample
+static const uint8_t bus_pins[OW_NUM_BUSES] = { 1 };
+#else
+static const uint8_t bus_pins[OW_NUM_BUSES] = OW_PINS;
+#endif
+
+static uint8_t all_buses_mask;
+static uint8_t bus_mask;
 
 static uint8_t last_diff;
 static uint8_t last_rom[OW_ROMCODE_SIZE];
 
+static volatile ow_async_status_t async_status = OW_ASYNC_IDLE;
+static ow_async_state_t async_state;
+static uint8_t async_cmd[1 + OW_ASYNC_MAX_TX];
+static uint8_t async_cmd_len;
+static uint8_t async_rom_len;
+static uint8_t async_tx_len;
+static uint8_t async_rx_len;
+static const uint8_t *async_id[OW_NUM_BUSES];
+static uint8_t *async_rx[OW_NUM_BUSES];
+static uint8_t async_byte[OW_NUM_BUSES];
+static uint8_t async_buses;     // buses taking part, one bit per bus index
+static uint8_t async_mask;      // port pins of these buses
+static uint8_t async_release;   // pins released early (written "1") in the next slot
+static uint8_t async_failed;    // buses that did not answer the reset
+static uint8_t async_pos;
+static uint8_t async_bit;
+
+// ROM search run by the engine, one id bit per three time slots
+static ow_search_t *async_search;
+static uint8_t async_search_rom[OW_ROMCODE_SIZE];
+static uint8_t async_search_diff;
+static uint8_t async_search_num;    // current id bit (1-64), 0 when not searching
+static uint8_t async_search_step;
+static bool async_search_id_bit;
+
+
+static uint8_t ow_async_tx_byte(uint8_t bus)
+{
+    uint8_t pos = async_pos;
+
+    if (pos < async_rom_len)
+    {
+        if (pos == 0)
+            return (async_id[bus] != NULL) ? OW_MATCH_ROM : OW_SKIP_ROM;
+
+        return async_id[bus][pos - 1];
+    }
+
+    pos -= async_rom_len;
+
+    if (pos < async_cmd_len)
+        return async_cmd[pos];
+
+    return 0xFF;    // read slots
+}
+
+static void ow_async_prepare_slot(void)
+{
+    uint8_t bus;
+
+    async_release = 0;
+
+    for (bus = 0; bus < OW_NUM_BUSES; bus++)
+    {
+        if ((async_buses & _BV(bus)) && (async_byte[bus] & 0x1))
+            async_release |= bus_pins[bus];
+    }
+}
+
+static void ow_async_load_bytes(void)
+{
+    uint8_t bus;
+
+    for (bus = 0; bus < OW_NUM_BUSES; bus++)
+    {
+        if (async_buses & _BV(bus))
+            async_byte[bus] = ow_async_tx_byte(bus);
+    }
+
+    async_bit = 0;
+}
+
+static void ow_async_begin_slots(void)
+{
+    async_pos = 0;
+    ow_async_load_bytes();
+    ow_async_prepare_slot();
+}
+
+/* read id bit, read complement, write direction: the same decisions as
+   ow_search_rom(), made between two time slots */
+static bool ow_async_search_slot(uint8_t sample)
+{
+    uint8_t *byte = &async_search_rom[(async_search_num - 1) >> 3];
+    uint8_t mask = 1 << ((async_search_num - 1) & 0x7);
+    bool dir;
+
+    switch (async_search_step++)
+    {
+        case 0:
+            async_search_id_bit = (sample != 0);
+            return true;                // read the complement next
+
+        case 1:
+            if (async_search_id_bit && sample)
+            {
+                async_failed = async_buses;     // no device answered
+                return false;
+            }
+
+            if (async_search_id_bit == (sample != 0))
+            {
+                // discrepancy, follow the previous path up to last_diff
+                if (async_search_num < async_search->last_diff)
+                    dir = ((*byte & mask) != 0);
+                else
+                    dir = (async_search_num == async_search->last_diff);
+
+                if (!dir)
+                    async_search_diff = async_search_num;
+            }
+            else
+            {
+                dir = async_search_id_bit;
+            }
+
+            if (dir)
+                *byte |= mask;
+            else
+                *byte &= ~mask;
+
+            async_release = dir ? async_mask : 0;
+            return true;
+
+        default:
+            if (++async_search_num > OW_ROMCODE_SIZE * 8)
+                return false;
+
+            async_search_step = 0;
+            async_release = async_mask;
+            return true;
+    }
+}
+
+/* shift in the bits read back in the last time slot (one pin per bus in
+   sample), returns false when this was the last slot of the transaction */
+static bool ow_async_slot_done(uint8_t sample)
+{
+    uint8_t bus;
+    bool byte_done;
+
+    if (async_search_num != 0 && async_pos == async_tx_len)
+        return ow_async_search_slot(sample & async_mask);
+
+    byte_done = (++async_bit == 8);
+
+    for (bus = 0; bus < OW_NUM_BUSES; bus++)
+    {
+        uint8_t byte;
+
+        if (!(async_buses & _BV(bus)))
+            continue;
+
+        byte = async_byte[bus] >> 1;
+        if (sample & bus_pins[bus])
+            byte |= 0x80;
+        async_byte[bus] = byte;
+
+        if (byte_done && async_pos >= async_tx_len)
+            async_rx[bus][async_pos - async_tx_len] = byte;
+    }
+
+    if (byte_done)
+    {
+        if (++async_pos == async_tx_len + async_rx_len)
+        {
+            if (async_search_num == 0)
+                return false;
+
+            // search triplets follow the command, starting with two reads
+            async_release = async_mask;
+            return true;
+        }
+
+        ow_async_load_bytes();
+    }
+
+    ow_async_prepare_slot();
+
+    return true;
+}
+
+#if OW_USE_USART
+
+static void ow_usart_set_baud(uint16_t ubrr)
+{
+    UBRR1 = ubrr;
+}
+
+static void ow_async_finish(ow_async_status_t status)
+{
+    UCSR1B &= ~_BV(RXCIE1);
+    async_status = status;
+}
+
+static void ow_usart_send_slot(void)
+{
+    UDR1 = async_release ? OW_USART_SLOT_1 : OW_USART_SLOT_0;
+}
+
+/* Every frame echoed back on RXD1 completes one time slot. The ISR
+   immediately queues the next one, so a whole byte is clocked out
+   without the main loop being involved, at one interrupt per slot. The
+   UDRE double buffer is not used: the echo of each slot has to be read
+   anyway (the RX FIFO holds two frames), and in a ROM search the next
+   slot depends on the bits just read. */
+ISR(USART1_RX_vect)
+{
+    bool framing_error = bit_is_set(UCSR1A, FE1);
+    uint8_t data = UDR1;
+
+    if (async_state == ASYNC_RESET_SAMPLE)
+    {
+        // unchanged echo means no presence pulse, framing error a short
+        if (data == OW_USART_RESET || framing_error)
+        {
+            async_failed = async_buses;
+            ow_async_finish(OW_ASYNC_ERROR);
+            return;
+        }
+
+        ow_usart_set_baud(OW_UBRR_SLOT);
+        async_state = ASYNC_SLOT_END;
+        ow_async_begin_slots();
+        ow_usart_send_slot();
+        return;
+    }
+
+    if (!ow_async_slot_done(data == OW_USART_SLOT_1))
+    {
+        ow_async_finish(OW_ASYNC_DONE);
+        return;
+    }
+
+    ow_usart_send_slot();
+}
+
+void ow_init(void)
+{
+    all_buses_mask = bus_mask = bus_pins[0];
+
+    ow_usart_set_baud(OW_UBRR_SLOT);
+    UCSR1A = 0;
+    UCSR1C = _BV(UCSZ11) | _BV(UCSZ10);
+    UCSR1B = _BV(RXEN1) | _BV(TXEN1);
+}
+
+void ow_set_bus(uint8_t bus)
+{
+}
+
+uint8_t ow_input_pin_state()
+{
+    return (PIND & _BV(PD2));
+}
+
+static uint8_t ow_usart_transfer(uint8_t data)
+{
+    // discard stale frames
+    while (bit_is_set(UCSR1A, RXC1))
+        (void) UDR1;
+
+    UDR1 = data;
+    loop_until_bit_is_set(UCSR1A, RXC1);
+
+    return UDR1;
+}
+
+bool ow_reset(void)
+{
+    bool framing_error;
+    uint8_t data;
+
+    ow_usart_set_baud(OW_UBRR_RESET);
+
+    // the 0xF0 frame holds the bus low for ~520us, a presence pulse
+    // pulls some of the high data bits low
+    UDR1 = OW_USART_RESET;
+    loop_until_bit_is_set(UCSR1A, RXC1);
+    framing_error = bit_is_set(UCSR1A, FE1);
+    data = UDR1;
+
+    ow_usart_set_baud(OW_UBRR_SLOT);
+
+    if (framing_error)
+        return false;          // short circuit, expected high but got low
+
+    return (data != OW_USART_RESET);
+}
+
+uint8_t ow_write_bit(uint8_t bit)
+{
+    uint8_t data;
+
+    data = ow_usart_transfer((bit & 0x1) ? OW_USART_SLOT_1 : OW_USART_SLOT_0);
+
+    return (data == OW_USART_SLOT_1);
+}
+
+uint8_t ow_write_byte(uint8_t byte)
+{
+    // the RX interrupt clocks out all 8 slots, one interrupt per slot
+    async_cmd[0] = byte;
+    async_cmd_len = 1;
+    async_rom_len = 0;
+    async_tx_len = 1;
+    async_rx_len = 0;
+    async_search_num = 0;
+    async_buses = 0x1;
+    async_state = ASYNC_SLOT_END;
+    async_status = OW_ASYNC_BUSY;
+    ow_async_begin_slots();
+
+    while (bit_is_set(UCSR1A, RXC1))
+        (void) UDR1;
+
+    UCSR1B |= _BV(RXCIE1);
+    ow_usart_send_slot();
+
+    while (async_status == OW_ASYNC_BUSY)
+        ;
+
+    async_status = OW_ASYNC_IDLE;
+
+    return async_byte[0];
+}
+
+#else
+
+static uint8_t async_sample;
+
+static void ow_async_finish(ow_async_status_t status)
+{
+    TIMSK1 &= ~_BV(OCIE1A);
+    async_status = status;
+}
+
+static void ow_async_drop_buses(uint8_t pins)
+{
+    uint8_t bus;
+
+    for (bus = 0; bus < OW_NUM_BUSES; bus++)
+    {
+        if (pins & bus_pins[bus])
+        {
+            async_buses &= ~_BV(bus);
+            async_failed |= _BV(bus);
+        }
+    }
+
+    async_mask &= ~pins;
+}
+
+/* Each compare match advances the transaction by one step. Only the first
+   15us of a bit slot (drive low, release, sample) are spent inside the ISR,
+   the remainder of the slot and the recovery time are left to the timer.
+   All buses taking part share the slot: one port write drives them low,
+   one PIN read samples them. */
+ISR(TIMER1_COMPA_vect)
+{
+    switch (async_state)
+    {
+        case ASYNC_RESET_RELEASE:
+            OW_DIR_IN(async_mask);
+#if OW_USE_INTERNAL_PULLUP
+            OW_OUT_HIGH(async_mask);
+#endif
+            OCR1A += OW_US_TO_TICKS(70);
+            async_state = ASYNC_RESET_SAMPLE;
+            break;
+
+        case ASYNC_RESET_SAMPLE:
+            async_sample = OW_GET_IN(async_mask);
+            OCR1A += OW_US_TO_TICKS(480 - 70);
+            async_state = ASYNC_RESET_END;
+            break;
+
+        case ASYNC_RESET_END:
+            // drop buses without presence pulse or with a short circuit
+            ow_async_drop_buses(async_sample |
+                    (OW_GET_IN(async_mask) ^ async_mask));
+
+            if (async_buses == 0)
+            {
+                ow_async_finish(OW_ASYNC_ERROR);
+                break;
+            }
+
+            ow_async_begin_slots();
+            // fall through to the first time slot
+
+        case ASYNC_SLOT_START:
+#if OW_USE_INTERNAL_PULLUP
+            OW_OUT_LOW(async_mask);
+#endif
+            OW_DIR_OUT(async_mask);    // drive buses low
+            _delay_us(2);
+            OW_DIR_IN(async_release);  // release buses writing "1"
+#if OW_USE_INTERNAL_PULLUP
+            OW_OUT_HIGH(async_release);
+#endif
+
+            _delay_us(15-2);
+
+            // keep the sample until the slot has ended
+            async_sample = OW_GET_IN(async_mask);
+
+            OCR1A += OW_US_TO_TICKS(60);
+            async_state = ASYNC_SLOT_END;
+            break;
+
+        case ASYNC_SLOT_END:
+#if OW_USE_INTERNAL_PULLUP
+            OW_OUT_HIGH(async_mask);
+#endif
+            OW_DIR_IN(async_mask);
+
+            if (!ow_async_slot_done(async_sample))
+            {
+                ow_async_finish(async_failed ? OW_ASYNC_ERROR : OW_ASYNC_DONE);
+                break;
+            }
+
+            OCR1A += OW_US_TO_TICKS(OW_RECOVERY_TIME);
+            async_state = ASYNC_SLOT_START;
+            break;
+    }
+}
+
+void ow_init(void)
+{
+    uint8_t bus;
+
+    all_buses_mask = 0;
+
+    for (bus = 0; bus < OW_NUM_BUSES; bus++)
+        all_buses_mask |= bus_pins[bus];
+
+    bus_mask = bus_pins[0];
+    OW_DIR_IN(all_buses_mask);
+
+    // normal mode, no prescaler, compare interrupt enabled per transaction
+    TCCR1A = 0;
+    TCCR1B = _BV(CS10);
+    TIMSK1 = 0;
+}
+
+/* select the bus used by the blocking functions, with OW_ALL_BUSES
+   every bus is driven at once and read back as wired-and */
+void ow_set_bus(uint8_t bus)
+{
+    if (bus == OW_ALL_BUSES)
+        bus_mask = all_buses_mask;
+    else if (bus < OW_NUM_BUSES)
+        bus_mask = bus_pins[bus];
+}
+
 uint8_t ow_input_pin_state()
 {
-    return OW_GET_IN();
+    return OW_GET_IN(bus_mask);
 }
 
 bool ow_reset(void)
 {
     uint8_t presence;
     
-    OW_OUT_LOW();
-    OW_DIR_OUT();            // pull OW-Pin low for 480us
+    OW_OUT_LOW(bus_mask);
+    OW_DIR_OUT(bus_mask);    // pull OW-Pin low for 480us
     _delay_us(480);
 
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
     {
         // set Pin as input - wait for clients to pull low
-        OW_DIR_IN(); // input
+        OW_DIR_IN(bus_mask); // input
 #if OW_USE_INTERNAL_PULLUP
-        OW_OUT_HIGH();
+        OW_OUT_HIGH(bus_mask);
 #endif
     
         _delay_us(70);       // was 66
-        presence = OW_GET_IN();   // no presence detect
+        presence = OW_GET_IN(bus_mask);   // no presence detect
                              // if err!=0: nobody pulled to low, still high
     }
     
     // after a delay the clients should release the line
     // and input-pin gets back to high by pull-up-resistor
     _delay_us(480 - 70);       // was 480-66
-    if(OW_GET_IN() == 0)
+    if(OW_GET_IN(bus_mask) != bus_mask)
     {
         return false;          // short circuit, expected high but got low
     }
@@ -104,15 +607,15 @@ uint8_t ow_write_bit(uint8_t bit)
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
     {
 #if OW_USE_INTERNAL_PULLUP
-        OW_OUT_LOW();
+        OW_OUT_LOW(bus_mask);
 #endif
-        OW_DIR_OUT();    // drive bus low
+        OW_DIR_OUT(bus_mask);    // drive bus low
         _delay_us(2);    // T_INT > 1usec accoding to timing-diagramm
         if (bit & 0x1)
         {
-            OW_DIR_IN(); // to write "1" release bus, resistor pulls high
+            OW_DIR_IN(bus_mask); // to write "1" release bus, resistor pulls high
 #if OW_USE_INTERNAL_PULLUP
-            OW_OUT_HIGH();
+            OW_OUT_HIGH(bus_mask);
 #endif
         }
 
@@ -122,16 +625,16 @@ uint8_t ow_write_bit(uint8_t bit)
         // the start of the slot."
         _delay_us(15-2);
         
-        if (OW_GET_IN() == 0)
+        if (OW_GET_IN(bus_mask) != bus_mask)
         {
             bit = 0;  // sample at end of read-timeslot
         }
     
         _delay_us(60-15);
 #if OW_USE_INTERNAL_PULLUP
-        OW_OUT_HIGH();
+        OW_OUT_HIGH(bus_mask);
 #endif
-        OW_DIR_IN();
+        OW_DIR_IN(bus_mask);
     
     } /* ATOMIC_BLOCK */
 
@@ -158,6 +661,8 @@ uint8_t ow_write_byte(uint8_t byte)
     return byte;
 }
 
+#endif
+
 void ow_reset_search(void)
 {
     last_diff = OW_SEARCH_FIRST;
@@ -242,6 +747,152 @@ void ow_command(uint8_t command, const uint8_t *id)
     ow_write_byte(command);
 }
 
+bool ow_async_begin(uint8_t command, const uint8_t *tx, uint8_t tx_len,
+        uint8_t rx_len)
+{
+    uint8_t i;
+
+    if (async_status == OW_ASYNC_BUSY || tx_len > OW_ASYNC_MAX_TX)
+        return false;
+
+    async_cmd[0] = command;
+
+    for (i = 0; i < tx_len; i++)
+        async_cmd[i + 1] = tx[i];
+
+    async_cmd_len = tx_len + 1;
+    async_rx_len = rx_len;
+    async_rom_len = 0;
+    async_search_num = 0;
+    async_buses = 0;
+    async_mask = 0;
+    async_failed = 0;
+
+    return true;
+}
+
+bool ow_async_add(uint8_t bus, const uint8_t *id, uint8_t *rx)
+{
+    uint8_t rom_len = (id != NULL) ? (1 + OW_ROMCODE_SIZE) : 1;
+
+    // all buses share the time slots, so they need the same ROM command
+    if (bus >= OW_NUM_BUSES || (async_buses & _BV(bus)) ||
+            (async_buses != 0 && rom_len != async_rom_len) ||
+            (rx == NULL && async_rx_len > 0))
+        return false;
+
+    async_id[bus] = id;
+    async_rx[bus] = rx;
+    async_rom_len = rom_len;
+    async_buses |= _BV(bus);
+    async_mask |= bus_pins[bus];
+
+    return true;
+}
+
+bool ow_async_run(void)
+{
+    if (async_status == OW_ASYNC_BUSY || async_buses == 0)
+        return false;
+
+    async_tx_len = async_rom_len + async_cmd_len;
+    async_status = OW_ASYNC_BUSY;
+
+#if OW_USE_USART
+    // the reset frame is echoed after ~1ms, the RX interrupt takes over
+    async_state = ASYNC_RESET_SAMPLE;
+    ow_usart_set_baud(OW_UBRR_RESET);
+
+    while (bit_is_set(UCSR1A, RXC1))
+        (void) UDR1;
+
+    UCSR1B |= _BV(RXCIE1);
+    UDR1 = OW_USART_RESET;
+#else
+    async_state = ASYNC_RESET_RELEASE;
+
+    // pull buses low for 480us, the ISR takes over from here
+    OW_OUT_LOW(async_mask);
+    OW_DIR_OUT(async_mask);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        OCR1A = TCNT1 + OW_US_TO_TICKS(480);
+        TIFR1 = _BV(OCF1A);
+        TIMSK1 |= _BV(OCIE1A);
+    }
+#endif
+
+    return true;
+}
+
+bool ow_async_start(uint8_t bus, uint8_t command, const uint8_t *id,
+        const uint8_t *tx, uint8_t tx_len, uint8_t *rx, uint8_t rx_len)
+{
+    uint8_t i;
+
+    if (!ow_async_begin(command, tx, tx_len, rx_len))
+        return false;
+
+    if (bus != OW_ALL_BUSES)
+        return ow_async_add(bus, id, rx) && ow_async_run();
+
+    // broadcast without reading back
+    for (i = 0; i < OW_NUM_BUSES; i++)
+        ow_async_add(i, NULL, NULL);
+
+    return ow_async_run();
+}
+
+ow_async_status_t ow_async_poll(void)
+{
+    return async_status;
+}
+
+uint8_t ow_async_failed_buses(void)
+{
+    return async_failed;
+}
+
+void ow_async_search_reset(ow_search_t *search)
+{
+    search->last_diff = OW_SEARCH_FIRST;
+    memset(search->rom, 0, OW_ROMCODE_SIZE);
+}
+
+bool ow_async_search(uint8_t bus, ow_search_t *search, bool alarm)
+{
+    if (bus >= OW_NUM_BUSES || search->last_diff == OW_LAST_DEVICE ||
+            !ow_async_begin(alarm ? OW_ALARM_SEARCH : OW_SEARCH_ROM,
+                NULL, 0, 0))
+        return false;
+
+    async_search = search;
+    memcpy(async_search_rom, search->rom, OW_ROMCODE_SIZE);
+    async_search_diff = OW_LAST_DEVICE;
+    async_search_num = 1;
+    async_search_step = 0;
+    async_buses = _BV(bus);
+    async_mask = bus_pins[bus];
+
+    return ow_async_run();
+}
+
+bool ow_async_search_result(ow_search_t *search, uint8_t *id)
+{
+    if (async_status != OW_ASYNC_DONE || async_failed)
+    {
+        search->last_diff = OW_LAST_DEVICE;     // end the search on this bus
+        return false;
+    }
+
+    search->last_diff = async_search_diff;
+    memcpy(search->rom, async_search_rom, OW_ROMCODE_SIZE);
+    memcpy(id, async_search_rom, OW_ROMCODE_SIZE);
+
+    return true;
+}
+
 uint8_t ow_crc8(const uint8_t *data, uint16_t len)
 {
     uint8_t crc = 0x00;
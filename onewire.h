@@ -7,6 +7,35 @@
 // rom-code size including CRC
 #define OW_ROMCODE_SIZE 8
 
+// number of buses, the pins are configured in onewire.c
+#define OW_NUM_BUSES 1
+#define OW_ALL_BUSES 0xFF
+
+// Use USART1 as bus master instead of bit-banging a port pin. TXD1 drives
+// the bus through an open-drain buffer, RXD1 is connected to the bus and
+// reads back every time slot.
+#define OW_USE_USART               0  /* 0=port pin, 1=USART1 */
+
+// maximum number of bytes written after the function command
+#define OW_ASYNC_MAX_TX 4
+
+typedef struct ow_search_t
+{
+    uint8_t rom[OW_ROMCODE_SIZE];
+    uint8_t last_diff;
+} ow_search_t;
+
+typedef enum ow_async_status_t
+{
+    OW_ASYNC_IDLE,
+    OW_ASYNC_BUSY,
+    OW_ASYNC_DONE,
+    OW_ASYNC_ERROR,
+} ow_async_status_t;
+
+void ow_init(void);
+void ow_set_bus(uint8_t bus);
+
 bool ow_reset(void);
 uint8_t ow_write_bit(uint8_t bit);
 #define ow_read_bit() ow_write_bit(1)
@@ -18,4 +47,29 @@ void ow_command(uint8_t command, const uint8_t *id);
 uint8_t ow_input_pin_state(void);
 uint8_t ow_crc8(const uint8_t *data, uint16_t len);
 
+// Asynchronous transactions: reset, ROM select (skip if id is NULL), command,
+// tx_len written bytes and rx_len read bytes, all driven from the timer 1
+// compare interrupt. The blocking functions above must not be used while a
+// transaction is in flight.
+// ow_async_add() selects a device on another bus for the same transaction,
+// all buses then run in lockstep.
+bool ow_async_begin(uint8_t command, const uint8_t *tx, uint8_t tx_len,
+        uint8_t rx_len);
+bool ow_async_add(uint8_t bus, const uint8_t *id, uint8_t *rx);
+bool ow_async_run(void);
+// single bus shortcut, OW_ALL_BUSES broadcasts a command to every bus
+bool ow_async_start(uint8_t bus, uint8_t command, const uint8_t *id,
+        const uint8_t *tx, uint8_t tx_len, uint8_t *rx, uint8_t rx_len);
+ow_async_status_t ow_async_poll(void);
+uint8_t ow_async_failed_buses(void);
+
+// One step of a ROM search as a transaction, with its own search state so
+// several searches can be interleaved. With alarm set only devices with an
+// alarm condition answer. Returns false once the last device on the bus was
+// found. ow_async_search_result() fetches the id when the transaction is
+// done, false ends the search.
+void ow_async_search_reset(ow_search_t *search);
+bool ow_async_search(uint8_t bus, ow_search_t *search, bool alarm);
+bool ow_async_search_result(ow_search_t *search, uint8_t *id);
+
 #endif
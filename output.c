@@ -0,0 +1,168 @@
+#include <string.h>
+#include "output.h"
+#include "tick.h"
+
+// an output only starts once the others of its group have been off this long
+#define OUTPUT_CHANGEOVER_DELAY (60000UL / TICK_MS)
+
+#define S_TO_TICKS(s) ((uint32_t) (s) * (1000 / TICK_MS))
+
+struct output
+{
+    output_limits_t limits;
+    uint8_t group;
+    uint8_t level;          // granted level, 0 = off
+    uint32_t change_tick;   // last switch on or off
+    uint32_t start_tick;    // last switch on
+    uint32_t cycles;
+    uint32_t runtime;       // ticks, without the current on period
+};
+
+static struct output outputs[NUM_OUTPUTS];
+
+void output_init(const output_limits_t *limits)
+{
+    // as if every output had been off for a long time
+    uint32_t long_ago = tick_get() - INT32_MAX;
+    uint8_t i;
+
+    memset(outputs, 0, sizeof(outputs));
+
+    for (i = 0; i < NUM_OUTPUTS; i++)
+    {
+        outputs[i].limits = limits[i];
+        outputs[i].group = OUTPUT_NO_GROUP;
+        outputs[i].change_tick = long_ago;
+        outputs[i].start_tick = long_ago;
+    }
+}
+
+/* interlock: no other output of the group on or switched off within the
+   changeover delay */
+static bool others_off(output_channel_t channel, uint32_t now)
+{
+    uint8_t group = outputs[channel].group;
+    uint8_t i;
+
+    if (group == OUTPUT_NO_GROUP)
+        return true;
+
+    for (i = 0; i < NUM_OUTPUTS; i++)
+    {
+        if (i == channel || outputs[i].group != group)
+            continue;
+
+        if (outputs[i].level != 0 ||
+                (now - outputs[i].change_tick) < OUTPUT_CHANGEOVER_DELAY)
+            return false;
+    }
+
+    return true;
+}
+
+static bool start_allowed(output_channel_t channel, uint32_t now)
+{
+    struct output *out = &outputs[channel];
+
+    if ((now - out->change_tick) < S_TO_TICKS(out->limits.min_off))
+        return false;
+
+    // max cycles per hour as a minimum spacing of the starts
+    if (out->limits.max_cycles != 0 && (now - out->start_tick) <
+            S_TO_TICKS(3600) / out->limits.max_cycles)
+        return false;
+
+    return others_off(channel, now);
+}
+
+/* Ask for an output level (0 = off), returns the level to apply. Starts
+   wait for the minimum off time, the cycle limit and the interlock, an
+   output that has not run for its minimum on time keeps its level. */
+uint8_t output_request(output_channel_t channel, uint8_t level)
+{
+    struct output *out = &outputs[channel];
+    uint32_t now = tick_get();
+
+    if (out->level == 0)
+    {
+        if (level == 0 || !start_allowed(channel, now))
+            return 0;
+
+        out->change_tick = now;
+        out->start_tick = now;
+        out->cycles++;
+    }
+    else if (level == 0)
+    {
+        if ((now - out->change_tick) < S_TO_TICKS(out->limits.min_on))
+            return out->level;
+
+        out->runtime += now - out->change_tick;
+        out->change_tick = now;
+    }
+
+    out->level = level;
+
+    return level;
+}
+
+bool output_is_on(output_channel_t channel)
+{
+    return (outputs[channel].level != 0);
+}
+
+bool output_set_limits(output_channel_t channel, const output_limits_t *limits)
+{
+    if (channel >= NUM_OUTPUTS)
+        return false;
+
+    outputs[channel].limits = *limits;
+
+    return true;
+}
+
+const output_limits_t * output_get_limits(output_channel_t channel)
+{
+    return &outputs[channel].limits;
+}
+
+uint32_t output_get_cycles(output_channel_t channel)
+{
+    return outputs[channel].cycles;
+}
+
+// total on time in s
+uint32_t output_get_runtime(output_channel_t channel)
+{
+    struct output *out = &outputs[channel];
+    uint32_t runtime = out->runtime;
+
+    if (out->level != 0)
+        runtime += tick_get() - out->change_tick;
+
+    return runtime / (1000 / TICK_MS);
+}
+
+void output_reset_stats(void)
+{
+    uint32_t now = tick_get();
+    uint8_t i;
+
+    for (i = 0; i < NUM_OUTPUTS; i++)
+    {
+        outputs[i].cycles = 0;
+        outputs[i].runtime = 0;
+
+        // a running period counts from now on, runtime wraps back when
+        // the output switches off
+        if (outputs[i].level != 0)
+            outputs[i].runtime -= now - outputs[i].change_tick;
+    }
+}
+
+// the outputs of one control zone share a group
+void output_set_group(output_channel_t channel, uint8_t group)
+{
+    if (channel < NUM_OUTPUTS)
+        outputs[channel].group = group;
+}
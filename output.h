@@ -0,0 +1,37 @@
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "heater_control.h"
+
+// channel 0 is the fan, the relays of heater_control follow
+#define OUTPUT_FAN 0
+#define OUTPUT_RELAY 1
+#define NUM_OUTPUTS (OUTPUT_RELAY + HEATER_CHANNELS)
+#define OUTPUT_NONE 0xFF
+
+// outputs of one group are interlocked against each other
+#define OUTPUT_NO_GROUP 0xFF
+
+typedef uint8_t output_channel_t;
+
+// 0 disables a limit
+typedef struct output_limits_t
+{
+    uint16_t min_on;        // s
+    uint16_t min_off;       // s
+    uint8_t max_cycles;     // starts per hour
+} output_limits_t;
+
+void output_init(const output_limits_t *limits);
+uint8_t output_request(output_channel_t channel, uint8_t level);
+bool output_is_on(output_channel_t channel);
+bool output_set_limits(output_channel_t channel, const output_limits_t *limits);
+const output_limits_t * output_get_limits(output_channel_t channel);
+uint32_t output_get_cycles(output_channel_t channel);
+uint32_t output_get_runtime(output_channel_t channel);
+void output_reset_stats(void);
+void output_set_group(output_channel_t channel, uint8_t group);
+
+#endif /* _OUTPUT_H_ */
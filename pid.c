@@ -0,0 +1,129 @@
+#include "pid.h"
+
+/* The integral is the sum of error * dt in fixed point degrees * ms /
+   INTEGRAL_DIV, ki is applied to the sum, so small errors still add up. */
+#define INTEGRAL_DIV 16
+#define INTEGRAL_SCALE ((int32_t) FIX_ONE * 1000 / INTEGRAL_DIV)
+
+static int16_t clamp(int32_t val, int16_t min, int16_t max)
+{
+    if (val < min)
+        return min;
+
+    if (val > max)
+        return max;
+
+    return val;
+}
+
+void pid_init(pid_controller_t *pid, const pid_gains_t *gains, bool reverse)
+{
+    pid->gains = *gains;
+    pid->reverse = reverse;
+    pid->out_min = PID_OUTPUT_MIN;
+    pid->deadband = 0;
+    pid_reset(pid);
+}
+
+// share of the integral in the output
+static int32_t integral_out(const pid_controller_t *pid, int32_t integral)
+{
+    return (int32_t) pid->gains.ki * integral / INTEGRAL_SCALE;
+}
+
+// change the gains, the output of the integral stays the same
+void pid_set_gains(pid_controller_t *pid, const pid_gains_t *gains)
+{
+    if (gains->ki > 0)
+        pid->integral = integral_out(pid, pid->integral) * INTEGRAL_SCALE /
+            gains->ki;
+    else
+        pid->integral = 0;
+
+    pid->gains = *gains;
+}
+
+// forget the history, e.g. after the controller was stopped
+void pid_reset(pid_controller_t *pid)
+{
+    pid->initialized = false;
+    pid->integral = 0;
+}
+
+/* one controller step, dt_ms since the last call, returns the output in
+   percent (out_min to PID_OUTPUT_MAX) */
+int16_t pid_update(pid_controller_t *pid, int16_t setpoint, int16_t input,
+        uint16_t dt_ms)
+{
+    int16_t error, d_input;
+    int32_t p, d, integral, out;
+
+    if (dt_ms == 0)
+        dt_ms = 1;
+    else if (dt_ms > PID_MAX_DT)
+        dt_ms = PID_MAX_DT;
+
+    if (!pid->initialized)
+    {
+        pid->last_input = input;
+        pid->initialized = true;
+    }
+
+    error = clamp((int32_t) setpoint - input, INT16_MIN, INT16_MAX);
+    d_input = clamp((int32_t) input - pid->last_input, INT16_MIN, INT16_MAX);
+    pid->last_input = input;
+
+    if (pid->reverse)
+    {
+        error = -error;
+        d_input = -d_input;
+    }
+
+    if (error > pid->deadband)
+        error -= pid->deadband;
+    else if (error < -pid->deadband)
+        error += pid->deadband;
+    else
+        error = 0;
+
+    p = FIX_MUL(pid->gains.kp, error);
+
+    // the integral alone never exceeds the output range
+    if (pid->gains.ki > 0)
+    {
+        int32_t min = (int32_t) pid->out_min * INTEGRAL_SCALE / pid->gains.ki;
+        int32_t max = (int32_t) PID_OUTPUT_MAX * INTEGRAL_SCALE /
+            pid->gains.ki;
+
+        integral = pid->integral + (int32_t) error * dt_ms / INTEGRAL_DIV;
+
+        if (integral < min)
+            integral = min;
+        else if (integral > max)
+            integral = max;
+    }
+    else
+    {
+        integral = 0;
+    }
+
+    /* derivative on measurement, setpoint changes don't kick the output.
+       kd * d_input is limited to what gives a full output at PID_MAX_DT,
+       so the scaling by time can't overflow. */
+    d = FIX_MUL(pid->gains.kd, d_input);
+    if (d > (int32_t) PID_OUTPUT_MAX * PID_MAX_DT / 1000)
+        d = (int32_t) PID_OUTPUT_MAX * PID_MAX_DT / 1000;
+    else if (d < -(int32_t) PID_OUTPUT_MAX * PID_MAX_DT / 1000)
+        d = -(int32_t) PID_OUTPUT_MAX * PID_MAX_DT / 1000;
+    d = -(int32_t) clamp(d * 1000 / dt_ms, -PID_OUTPUT_MAX, PID_OUTPUT_MAX);
+
+    out = p + integral_out(pid, integral) + d;
+
+    // stop integrating while the output saturates in the same direction
+    if (!((out > PID_OUTPUT_MAX && error > 0) ||
+            (out < pid->out_min && error < 0)))
+        pid->integral = integral;
+
+    return clamp(p + integral_out(pid, pid->integral) + d, pid->out_min,
+            PID_OUTPUT_MAX);
+}
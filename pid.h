@@ -0,0 +1,41 @@
+#ifndef _PID_H_
+#define _PID_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fix_point.h"
+
+// output range, percent in fixed point, negative outputs are only used
+// with a second actuator working against the first (heating and cooling)
+#define PID_OUTPUT_MIN 0
+#define PID_OUTPUT_MAX INT_TO_FIX(100)
+
+// longer update intervals are clamped
+#define PID_MAX_DT 10000
+
+// all gains in fixed point
+typedef struct pid_gains_t
+{
+    int16_t kp;     // percent per degree
+    int16_t ki;     // percent per degree and second
+    int16_t kd;     // percent per degree/second
+} pid_gains_t;
+
+typedef struct pid_controller_t
+{
+    pid_gains_t gains;
+    bool reverse;       // output lowers the input, e.g. cooling
+    int16_t out_min;    // PID_OUTPUT_MIN or -PID_OUTPUT_MAX
+    int16_t deadband;   // errors up to this size count as zero
+    bool initialized;
+    int16_t last_input;
+    int32_t integral;   // error * time, see pid.c
+} pid_controller_t;
+
+void pid_init(pid_controller_t *pid, const pid_gains_t *gains, bool reverse);
+void pid_set_gains(pid_controller_t *pid, const pid_gains_t *gains);
+void pid_reset(pid_controller_t *pid);
+int16_t pid_update(pid_controller_t *pid, int16_t setpoint, int16_t input,
+        uint16_t dt_ms);
+
+#endif /* _PID_H_ */
@@ -0,0 +1,262 @@
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+#include "temp_control.h"
+#include "settings.h"
+#include "tick.h"
+
+#define TICKS_PER_S (1000 / TICK_MS)
+#define S_PER_HOUR 3600UL
+
+struct profile_run
+{
+    profile_state_t state;
+    uint8_t segment;
+    uint32_t second_tick;   // tick of the last whole second
+    uint32_t elapsed;       // s since the segment start
+    int16_t from;           // setpoint at the segment start
+    uint32_t ramp;          // distance covered, 1/3600 fixed point steps
+    int16_t setpoint;
+};
+
+static struct profile_run runs[MAX_ZONES];
+
+static const profile_segment_t * current_segment(uint8_t zone)
+{
+    return &settings.profiles[zone].segments[runs[zone].segment];
+}
+
+static void save_progress(uint8_t zone)
+{
+    struct profile_run *run = &runs[zone];
+    profile_progress_t progress;
+
+    progress.state = run->state;
+    progress.segment = run->segment;
+    progress.elapsed = run->elapsed / 60;
+    progress.from = (run->state == PROFILE_DONE) ? run->setpoint : run->from;
+    settings_save_progress(zone, &progress);
+}
+
+static void apply_setpoint(uint8_t zone, int16_t setpoint)
+{
+    if (setpoint == runs[zone].setpoint)
+        return;
+
+    runs[zone].setpoint = setpoint;
+    temp_control_set_target_temp(zone, setpoint);
+}
+
+// setpoint after covering ramp of the distance to the segment target
+static int16_t ramp_setpoint(uint8_t zone)
+{
+    struct profile_run *run = &runs[zone];
+    int16_t target = current_segment(zone)->target;
+    uint16_t distance = labs((int32_t) target - run->from);
+    uint32_t step = run->ramp / S_PER_HOUR;
+
+    if (step >= distance)
+        return target;
+
+    return (target > run->from) ? run->from + step : run->from - step;
+}
+
+/* Enter a segment elapsed seconds after its start. The distance covered
+   so far is computed once, afterwards it grows by the rate every second. */
+static void enter_segment(uint8_t zone, uint8_t segment, uint32_t elapsed)
+{
+    struct profile_run *run = &runs[zone];
+    const profile_segment_t *seg;
+    uint32_t distance;
+
+    run->segment = segment;
+    run->elapsed = elapsed;
+    seg = current_segment(zone);
+
+    distance = (uint32_t) labs((int32_t) seg->target - run->from) *
+        S_PER_HOUR;
+
+    if (seg->rate == 0 || elapsed >= distance / seg->rate)
+        run->ramp = distance;
+    else
+        run->ramp = (uint32_t) seg->rate * elapsed;
+
+    apply_setpoint(zone, ramp_setpoint(zone));
+}
+
+static void next_segment(uint8_t zone)
+{
+    struct profile_run *run = &runs[zone];
+
+    run->from = run->setpoint;
+
+    if (run->segment + 1 >= settings.profiles[zone].num_segments)
+    {
+        // hold the last setpoint
+        run->state = PROFILE_DONE;
+        save_progress(zone);
+        return;
+    }
+
+    enter_segment(zone, run->segment + 1, 0);
+    save_progress(zone);
+}
+
+static void advance_second(uint8_t zone)
+{
+    struct profile_run *run = &runs[zone];
+    const profile_segment_t *seg = current_segment(zone);
+
+    run->elapsed++;
+
+    if (run->setpoint != seg->target)
+    {
+        run->ramp += seg->rate;
+        apply_setpoint(zone, ramp_setpoint(zone));
+    }
+
+    if (run->elapsed >= (uint32_t) seg->duration * 60)
+        next_segment(zone);
+    else if (run->elapsed % (PROFILE_SAVE_INTERVAL * 60) == 0)
+        save_progress(zone);
+}
+
+static bool valid_profile(const profile_t *profile)
+{
+    uint8_t i;
+
+    if (profile->num_segments == 0 ||
+            profile->num_segments > PROFILE_MAX_SEGMENTS)
+        return false;
+
+    for (i = 0; i < profile->num_segments; i++)
+    {
+        if (profile->segments[i].rate < 0)
+            return false;
+    }
+
+    return true;
+}
+
+/* resume the profiles that were running at power down, from the last
+   saved position */
+void profile_init(void)
+{
+    uint8_t zone;
+
+    for (zone = 0; zone < MAX_ZONES; zone++)
+    {
+        profile_progress_t progress;
+        struct profile_run *run = &runs[zone];
+
+        run->state = PROFILE_STOPPED;
+        run->setpoint = temp_control_get_target_temp(zone);
+
+        if (!valid_profile(&settings.profiles[zone]) ||
+                !settings_load_progress(zone, &progress))
+            continue;
+
+        if (progress.state == PROFILE_DONE)
+        {
+            run->state = PROFILE_DONE;
+            apply_setpoint(zone, progress.from);
+        }
+        else if (progress.state == PROFILE_RUNNING &&
+                progress.segment < settings.profiles[zone].num_segments)
+        {
+            run->state = PROFILE_RUNNING;
+            run->from = progress.from;
+            run->second_tick = tick_get();
+            enter_segment(zone, progress.segment,
+                    (uint32_t) progress.elapsed * 60);
+        }
+    }
+}
+
+void profile_update(void)
+{
+    uint32_t now = tick_get();
+    uint8_t zone;
+
+    for (zone = 0; zone < MAX_ZONES; zone++)
+    {
+        struct profile_run *run = &runs[zone];
+
+        while (run->state == PROFILE_RUNNING &&
+                (now - run->second_tick) >= TICKS_PER_S)
+        {
+            run->second_tick += TICKS_PER_S;
+            advance_second(zone);
+        }
+    }
+}
+
+// store the segments of a zone, a running profile of the zone is stopped
+bool profile_set(uint8_t zone, const profile_segment_t *segments,
+        uint8_t num_segments)
+{
+    profile_t profile;
+
+    if (zone >= MAX_ZONES || num_segments > PROFILE_MAX_SEGMENTS)
+        return false;
+
+    memset(&profile, 0, sizeof(profile));
+    profile.num_segments = num_segments;
+    memcpy(profile.segments, segments,
+            num_segments * sizeof(profile_segment_t));
+
+    if (num_segments != 0 && !valid_profile(&profile))
+        return false;
+
+    runs[zone].state = PROFILE_STOPPED;
+    settings.profiles[zone] = profile;
+    settings_save();
+    save_progress(zone);
+
+    return true;
+}
+
+const profile_t * profile_get(uint8_t zone)
+{
+    return &settings.profiles[zone];
+}
+
+// run the profile of a zone from the given segment on
+bool profile_start(uint8_t zone, uint8_t segment)
+{
+    struct profile_run *run;
+
+    if (zone >= MAX_ZONES || !valid_profile(&settings.profiles[zone]) ||
+            segment >= settings.profiles[zone].num_segments)
+        return false;
+
+    run = &runs[zone];
+    run->state = PROFILE_RUNNING;
+    run->setpoint = temp_control_get_target_temp(zone);
+    run->from = run->setpoint;
+    run->second_tick = tick_get();
+    enter_segment(zone, segment, 0);
+    save_progress(zone);
+
+    return true;
+}
+
+// the setpoint stays where the profile left it
+void profile_stop(uint8_t zone)
+{
+    if (zone >= MAX_ZONES || runs[zone].state == PROFILE_STOPPED)
+        return;
+
+    runs[zone].state = PROFILE_STOPPED;
+    save_progress(zone);
+    temp_control_save_target_temp(zone);
+}
+
+profile_state_t profile_get_state(uint8_t zone, uint8_t *segment,
+        uint32_t *elapsed)
+{
+    *segment = runs[zone].segment;
+    *elapsed = runs[zone].elapsed;
+
+    return runs[zone].state;
+}
@@ -0,0 +1,55 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PROFILE_MAX_SEGMENTS 8
+
+/* the position of a running profile is saved this often, in minutes, and
+   on every segment change */
+#define PROFILE_SAVE_INTERVAL 60
+
+/* The setpoint ramps from its value at the segment start to target at
+   rate degrees per hour (0 steps at once), it then holds target until
+   duration minutes after the segment start. */
+typedef struct profile_segment_t
+{
+    int16_t target;
+    uint16_t duration;      // min
+    int16_t rate;           // fixed point degrees per hour, 0 = step
+} profile_segment_t;
+
+typedef struct profile_t
+{
+    uint8_t num_segments;
+    profile_segment_t segments[PROFILE_MAX_SEGMENTS];
+} profile_t;
+
+typedef enum profile_state_t
+{
+    PROFILE_STOPPED,
+    PROFILE_RUNNING,
+    PROFILE_DONE,
+} profile_state_t;
+
+// kept in eeprom to resume after a power cycle
+typedef struct profile_progress_t
+{
+    uint8_t state;
+    uint8_t segment;
+    uint16_t elapsed;       // min since the segment start
+    int16_t from;           // setpoint at the segment start, final when done
+} profile_progress_t;
+
+void profile_init(void);
+void profile_update(void);
+bool profile_set(uint8_t zone, const profile_segment_t *segments,
+        uint8_t num_segments);
+const profile_t * profile_get(uint8_t zone);
+bool profile_start(uint8_t zone, uint8_t segment);
+void profile_stop(uint8_t zone);
+profile_state_t profile_get_state(uint8_t zone, uint8_t *segment,
+        uint32_t *elapsed);
+
+#endif /* _PROFILE_H_ */
@@ -1,8 +1,14 @@
 #include <stdlib.h>
+#include <string.h>
 #include <util/crc16.h>
 #include "rpc.h"
 #include "uart.h"
 #include "temp_control.h"
+#include "tick.h"
+#include "fan_control.h"
+#include "heater_control.h"
+#include "profile.h"
+#include "history.h"
 
 #define RPC_SYNC_BYTE 0x7E
 #define RPC_ESCAPE_BYTE 0x7D
@@ -10,6 +16,60 @@
 
 #define RPC_COMMAND_LIST_DEVICES 0x01
 #define RPC_COMMAND_SET_TARGET_TEMP 0x02
+#define RPC_COMMAND_SET_RESOLUTION 0x03
+#define RPC_COMMAND_SET_SAMPLE_PERIOD 0x04
+#define RPC_COMMAND_GET_SAMPLE_CONFIG 0x05
+#define RPC_COMMAND_SET_SAMPLE_MODE 0x06
+#define RPC_COMMAND_GET_SAMPLE_AGES 0x07
+#define RPC_COMMAND_RENAME_SENSOR 0x08
+#define RPC_COMMAND_SWAP_SENSORS 0x09
+#define RPC_COMMAND_SET_TARGET_SENSOR 0x0A
+#define RPC_COMMAND_SET_ALARM_MONITOR 0x0B
+#define RPC_COMMAND_SET_CONTROL_MODE 0x0C
+#define RPC_COMMAND_SET_PID 0x0D
+#define RPC_COMMAND_GET_PID 0x0E
+#define RPC_COMMAND_AUTOTUNE 0x0F
+#define RPC_COMMAND_GET_AUTOTUNE 0x10
+#define RPC_COMMAND_SET_FAN_RPM 0x11
+#define RPC_COMMAND_GET_FAN 0x12
+#define RPC_COMMAND_SET_HEATING 0x13
+#define RPC_COMMAND_GET_HEATING 0x14
+#define RPC_COMMAND_SET_OUTPUT_LIMITS 0x15
+#define RPC_COMMAND_GET_OUTPUT_STATS 0x16
+#define RPC_COMMAND_RESET_OUTPUT_STATS 0x17
+#define RPC_COMMAND_GET_ZONES 0x18
+#define RPC_COMMAND_SET_ZONE_OUTPUTS 0x19
+#define RPC_COMMAND_SET_ZONE_RUNNING 0x1A
+#define RPC_COMMAND_SET_PROFILE 0x1B
+#define RPC_COMMAND_GET_PROFILE 0x1C
+#define RPC_COMMAND_RUN_PROFILE 0x1D
+#define RPC_COMMAND_SET_ADAPTIVE 0x1E
+#define RPC_COMMAND_GET_ADAPTIVE 0x1F
+#define RPC_COMMAND_GET_READINGS 0x20
+#define RPC_COMMAND_SET_FILTER 0x21
+#define RPC_COMMAND_SET_PREDICTOR 0x22
+#define RPC_COMMAND_GET_PREDICTOR 0x23
+#define RPC_COMMAND_GET_STATS 0x24
+#define RPC_COMMAND_RESET_STATS 0x25
+#define RPC_COMMAND_SET_STATS_WINDOWS 0x26
+#define RPC_COMMAND_GET_HISTORY 0x27
+#define RPC_COMMAND_GET_LINK_STATS 0x28
+#define RPC_COMMAND_SET_BAUD 0x29
+#define RPC_COMMAND_CONFIRM_BAUD 0x2A
+#define RPC_COMMAND_GET_BAUD 0x2B
+
+// unsolicited frames on the telemetry channel
+#define RPC_PUSH_READINGS 0x80
+
+// request/response endpoint and push-only telemetry stream
+#define RPC_CHANNEL UART_CHANNEL_0
+#if UART_USE_USART1
+#define RPC_TELEMETRY_CHANNEL UART_CHANNEL_1
+#define RPC_TELEMETRY_BAUD 250000
+#endif
+
+// a new baud rate has to be confirmed at that rate within this time, in ms
+#define BAUD_CONFIRM_TIMEOUT 2000
 
 typedef enum rpc_state_t
 {
@@ -23,175 +83,1298 @@ typedef enum rpc_state_t
 } rpc_state_t;
 
 static rpc_message_t recv_msg;
-static rpc_message_t send_msg;
 
+// largest frame, every byte escaped
+#define RPC_MAX_FRAME (2 * (3 + UINT8_MAX + 2) + 2)
+
+/* Frames are written straight into the transmit ring, each byte is added
+   to the crc and escaped on the way. A request is only taken once the
+   ring has room for the largest reply, so replies never wait. */
+struct rpc_writer
+{
+    uart_channel_t ch;
+    uint8_t *span;          // reserved part of the ring
+    uint16_t room;          // left in span
+    uint16_t used;          // written to span, not committed yet
+    uint8_t remaining;      // payload bytes announced but not written
+    uint16_t crc;
+};
+
+static struct rpc_writer writer;
+
+// a request waits in recv_msg until its reply fits
+static bool request_pending;
+static uint32_t pending_tick;
+static uint16_t deferred_requests;
+static uint32_t stall_ticks;
+#if UART_USE_USART1
+static uint16_t telemetry_dropped;
+#endif
+
+/* Baud rate negotiation: the rate is switched once the ack went out, the
+   default rate returns unless the host confirms the new one in time. */
+static uint32_t baud_next;
+static bool baud_unconfirmed;
+static uint32_t baud_tick;
+
+static void rpc_put_raw(uint8_t byte)
+{
+    if (writer.room == 0)
+    {
+        // the ring wraps, the frame continues at its start
+        uart_tx_commit(writer.ch, writer.used);
+        writer.used = 0;
+        writer.room = uart_tx_reserve(writer.ch, &writer.span);
+    }
+
+    writer.span[writer.used++] = byte;
+    writer.room--;
+}
+
+static void rpc_send_escaped(uint8_t byte)
+{
+    if (byte == RPC_SYNC_BYTE || byte == RPC_ESCAPE_BYTE)
+    {
+        rpc_put_raw(RPC_ESCAPE_BYTE);
+        byte ^= RPC_ESCAPE_XOR;
+    }
+
+    rpc_put_raw(byte);
+}
+
+// escaped and covered by the crc
+static void rpc_put_framed(uint8_t byte)
+{
+    writer.crc = _crc_ccitt_update(writer.crc, byte);
+    rpc_send_escaped(byte);
+}
+
+// payload byte, anything past the announced length is dropped
+static void rpc_put(uint8_t byte)
+{
+    if (writer.remaining == 0)
+        return;
+
+    writer.remaining--;
+    rpc_put_framed(byte);
+}
+
+static void rpc_put16(uint16_t value)
+{
+    rpc_put((value >> 8) & 0xFF);
+    rpc_put(value & 0xFF);
+}
+
+static void rpc_put32(uint32_t value)
+{
+    rpc_put16(value >> 16);
+    rpc_put16(value & 0xFFFF);
+}
+
+// starts a frame with len payload bytes, false if it might not fit
+static bool rpc_frame_begin(uart_channel_t ch, uint8_t cmd, uint8_t id,
+        uint8_t len)
+{
+    if (uart_tx_free(ch) < 2 * (3 + (uint16_t) len + 2) + 2)
+        return false;
+
+    writer.ch = ch;
+    writer.used = 0;
+    writer.room = uart_tx_reserve(ch, &writer.span);
+    writer.remaining = len;
+    writer.crc = 0xFFFF;
+
+    rpc_put_raw(RPC_SYNC_BYTE);
+    rpc_put_framed(cmd);
+    rpc_put_framed(id);
+    rpc_put_framed(len);
+
+    return true;
+}
+
+static void rpc_frame_end(void)
+{
+    uint16_t crc;
+
+    // keep the frame consistent with the announced length
+    while (writer.remaining != 0)
+        rpc_put(0);
+
+    crc = writer.crc;
+    rpc_send_escaped((crc >> 8) & 0xFF);
+    rpc_send_escaped(crc & 0xFF);
+    rpc_put_raw(RPC_SYNC_BYTE);   // probably not necessary
+
+    uart_tx_commit(writer.ch, writer.used);
+}
+
+static void rpc_reply_begin(uint8_t len)
+{
+    rpc_frame_begin(RPC_CHANNEL, 0x00, recv_msg.id, len);
+}
+
+static void rpc_reply_end(void)
+{
+    rpc_frame_end();
+}
 
 static void rpc_send_devices(void)
 {
-    uint8_t i, data_pos;
+    uint8_t i = 0;
     struct temp_sensor *sensor;
 
-    send_msg.cmd = 0x00;
-    send_msg.id = recv_msg.id;
-    send_msg.len = 0;
-
-    i = 0;
-    data_pos = 0;
+    // [rom code, name, temperature] per sensor
+    rpc_reply_begin(temp_control_get_num_sensors() *
+            (OW_ROMCODE_SIZE + 10 + sizeof(int16_t)));
 
     while ((sensor = temp_control_get_sensor_data(i++)) != NULL)
     {
         uint8_t j;
 
         for (j = 0; j < OW_ROMCODE_SIZE; j++)
-            send_msg.data[data_pos++] = sensor->id[j];
+            rpc_put(sensor->id[j]);
 
         for (j = 0; j < 10; j++)
-            send_msg.data[data_pos++] = sensor->name[j];
+            rpc_put(sensor->name[j]);
 
-        send_msg.data[data_pos++] = (sensor->temp >> 8) & 0xFF;
-        send_msg.data[data_pos++] = sensor->temp & 0xFF;
+        rpc_put16(sensor->temp);
     }
 
-    send_msg.len = data_pos;
-    send_msg.crc = rpc_calculate_crc(&send_msg);
+    rpc_reply_end();
+}
+
+static void rpc_send_ack(void)
+{
+    rpc_reply_begin(0);
+    rpc_reply_end();
+}
+
+/* Zone commands take an optional leading zone byte, without it they
+   address zone 0. The byte is removed so len bytes of arguments remain. */
+static bool rpc_take_zone(uint8_t len, uint8_t *zone)
+{
+    *zone = 0;
+
+    if (recv_msg.len == len)
+        return true;
 
-    rpc_send_message(&send_msg);
+    if (recv_msg.len != len + 1 || recv_msg.data[0] >= MAX_ZONES)
+        return false;
+
+    *zone = recv_msg.data[0];
+    memmove(recv_msg.data, &recv_msg.data[1], len);
+    recv_msg.len = len;
+
+    return true;
 }
 
 static bool rpc_set_target_temp(void)
 {
+    uint8_t zone;
     int16_t temp;
 
-    if (recv_msg.len != sizeof(int16_t))
+    if (!rpc_take_zone(sizeof(int16_t), &zone))
         return false;
 
     temp = ((int16_t) recv_msg.data[0] << 8) | recv_msg.data[1];
-    temp_control_set_target_temp(temp);
 
-    send_msg.cmd = 0x00;
-    send_msg.id = recv_msg.id;
-    send_msg.len = 0;
-    send_msg.crc = rpc_calculate_crc(&send_msg);
-    rpc_send_message(&send_msg);
+    // a manual setpoint overrides the profile
+    profile_stop(zone);
+    temp_control_set_target_temp(zone, temp);
+    temp_control_save_target_temp(zone);
+
+    rpc_send_ack();
 
     return true;
 }
 
-static bool rpc_parse_message(void)
+static bool rpc_set_resolution(void)
 {
-    switch (recv_msg.cmd)
+    // sensor, bits
+    if (recv_msg.len != 2)
+        return false;
+
+    if (!temp_control_set_resolution(recv_msg.data[0], recv_msg.data[1]))
+        return false;
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static bool rpc_set_sample_period(void)
+{
+    uint16_t period;
+
+    if (recv_msg.len != sizeof(uint16_t))
+        return false;
+
+    period = ((uint16_t) recv_msg.data[0] << 8) | recv_msg.data[1];
+
+    if (!temp_control_set_sample_period(period))
+        return false;
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static void rpc_send_sample_config(void)
+{
+    uint8_t i = 0;
+    uint16_t period = temp_control_get_sample_period();
+    struct temp_sensor *sensor;
+
+    rpc_reply_begin(sizeof(period) + 1 + temp_control_get_num_sensors());
+
+    rpc_put16(period);
+    rpc_put(temp_control_get_pipelined());
+
+    // resolution of every sensor in list order
+    while ((sensor = temp_control_get_sensor_data(i++)) != NULL)
+        rpc_put(sensor->resolution);
+
+    rpc_reply_end();
+}
+
+static bool rpc_set_sample_mode(void)
+{
+    // 0 = broadcast conversion, 1 = pipelined per-sensor conversions
+    if (recv_msg.len != 1 || recv_msg.data[0] > 1)
+        return false;
+
+    temp_control_set_pipelined(recv_msg.data[0]);
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static bool rpc_set_adaptive(void)
+{
+    // [0/1, ceiling in ms]
+    if (recv_msg.len != 1 + sizeof(uint16_t) || recv_msg.data[0] > 1 ||
+            !temp_control_set_adaptive(recv_msg.data[0],
+                ((uint16_t) recv_msg.data[1] << 8) | recv_msg.data[2]))
+        return false;
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static void rpc_send_adaptive(void)
+{
+    uint8_t i = 0;
+    uint16_t ceiling, interval = temp_control_get_sample_interval();
+    struct temp_sensor *sensor;
+
+    rpc_reply_begin(1 + 2 * sizeof(uint16_t) +
+            temp_control_get_num_sensors() * sizeof(int16_t));
+
+    rpc_put(temp_control_get_adaptive(&ceiling));
+    rpc_put16(ceiling);
+    rpc_put16(interval);
+
+    // rate of change of every sensor in degrees per minute
+    while ((sensor = temp_control_get_sensor_data(i++)) != NULL)
+        rpc_put16(sensor->rate);
+
+    rpc_reply_end();
+}
+
+static void rpc_send_readings(void)
+{
+    uint8_t i = 0;
+    int16_t max_jump;
+    uint16_t alpha = temp_control_get_filter(&max_jump);
+    struct temp_sensor *sensor;
+
+    // [filter alpha, max jump], then [raw, filtered, rejects] per sensor
+    rpc_reply_begin(2 * sizeof(uint16_t) + temp_control_get_num_sensors() * 3 * sizeof(int16_t));
+    rpc_put16(alpha);
+    rpc_put16(max_jump);
+
+    while ((sensor = temp_control_get_sensor_data(i++)) != NULL)
     {
-        case RPC_COMMAND_LIST_DEVICES:
-            rpc_send_devices();
-            return true;
-        case RPC_COMMAND_SET_TARGET_TEMP:
-            return rpc_set_target_temp();
-        default:
-            break;
+        rpc_put16(sensor->raw);
+        rpc_put16(sensor->temp);
+        rpc_put16(sensor->rejects);
     }
 
-    return false;
+    rpc_reply_end();
 }
 
-void rpc_init(void)
+static bool rpc_set_filter(void)
 {
-    uart_init();
+    // [alpha in 1/256, max jump], both 16 bit
+    if (recv_msg.len != 2 * sizeof(uint16_t) ||
+            !temp_control_set_filter(
+                ((uint16_t) recv_msg.data[0] << 8) | recv_msg.data[1],
+                ((int16_t) recv_msg.data[2] << 8) | recv_msg.data[3]))
+        return false;
+
+    rpc_send_ack();
+
+    return true;
 }
 
-bool rpc_process_message(void)
+static bool rpc_send_stats(void)
 {
-    static rpc_state_t state = WAITING_FOR_SYNC;
-    static uint8_t data_pos = 0;
-    static bool escape = false;
+    struct sensor_stats *stats;
+    uint8_t w;
+    int16_t mean, min, max;
+    uint32_t variance, length;
 
-    while (uart_bytes_available() > 0)
-    {
-        uint8_t byte = uart_getc();
+    if (recv_msg.len != 1 ||
+            recv_msg.data[0] >= temp_control_get_num_sensors())
+        return false;
 
-        if (byte == RPC_SYNC_BYTE)
-        {
-            state = COMMAND;
-            data_pos = 0;
-            continue;
-        }
+    stats = temp_control_get_stats(recv_msg.data[0]);
+    mean = stats_get_mean(stats);
+    variance = stats_get_variance(stats);
 
-        if (byte == RPC_ESCAPE_BYTE)
-        {
-            escape = true;
-            continue;
-        }
+    // [samples, mean, variance], then [length in s, min, max] per window,
+    // min > max if the window holds no readings
+    rpc_reply_begin(2 * sizeof(int16_t) + sizeof(uint32_t) +
+            STATS_NUM_WINDOWS * (sizeof(uint32_t) + 2 * sizeof(int16_t)));
+    rpc_put16(stats->count);
+    rpc_put16(mean);
+    rpc_put32(variance);
 
-        if (escape)
-        {
-            byte ^= RPC_ESCAPE_XOR;
-            escape = false;
-        }
+    for (w = 0; w < STATS_NUM_WINDOWS; w++)
+    {
+        length = stats_get_window(w);
 
-        switch (state)
+        if (!stats_get_min_max(stats, w, &min, &max))
         {
-            case WAITING_FOR_SYNC:
-                break;
-            case COMMAND:
-                recv_msg.cmd = byte;
-                state = ID;
-                break;
-            case ID:
-                recv_msg.id = byte;
-                state = LENGTH;
-                break;
-            case LENGTH:
-                recv_msg.len = byte;
-                if (recv_msg.len > 0)
-                    state = DATA;
-                else
-                    state = CRC1;
-                break;
-            case DATA:
-                recv_msg.data[data_pos++] = byte;
-                if (data_pos == recv_msg.len)
-                    state = CRC1;
-                break;
-            case CRC1:
-                recv_msg.crc = byte << 8;
-                state = CRC2;
-                break;
-            case CRC2:
-                recv_msg.crc |= byte;
-                state = WAITING_FOR_SYNC;
-                if (recv_msg.crc != rpc_calculate_crc(&recv_msg))
-                    return false;
-                return rpc_parse_message();
+            min = INT16_MAX;
+            max = INT16_MIN;
         }
+
+        rpc_put32(length);
+        rpc_put16(min);
+        rpc_put16(max);
     }
 
-    return false;
+    rpc_reply_end();
+
+    return true;
 }
 
-static void rpc_send_escaped(uint8_t byte)
+static bool rpc_reset_stats(void)
 {
-    if (byte == RPC_SYNC_BYTE || byte == RPC_ESCAPE_BYTE)
+    // [] resets all sensors, [sensor] a single one
+    if (recv_msg.len > 1 || !temp_control_reset_stats(
+                (recv_msg.len == 1) ? recv_msg.data[0] : NO_SENSOR))
+        return false;
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static bool rpc_set_stats_windows(void)
+{
+    uint32_t lengths[STATS_NUM_WINDOWS];
+    uint8_t w, data_pos = 0;
+
+    // [length in s] per window, 32 bit
+    if (recv_msg.len != sizeof(lengths))
+        return false;
+
+    for (w = 0; w < STATS_NUM_WINDOWS; w++)
     {
-        uart_putc(RPC_ESCAPE_BYTE);
-        uart_putc(byte ^ RPC_ESCAPE_XOR);
+        lengths[w] = ((uint32_t) recv_msg.data[data_pos] << 24) |
+            ((uint32_t) recv_msg.data[data_pos + 1] << 16) |
+            ((uint32_t) recv_msg.data[data_pos + 2] << 8) |
+            recv_msg.data[data_pos + 3];
+        data_pos += sizeof(uint32_t);
+
+        if (lengths[w] < STATS_MIN_WINDOW || lengths[w] > STATS_MAX_WINDOW)
+            return false;
     }
+
+    for (w = 0; w < STATS_NUM_WINDOWS; w++)
+        temp_control_set_stats_window(w, lengths[w]);
+
+    rpc_send_ack();
+
+    return true;
 }
 
-void rpc_send_message(const rpc_message_t *msg)
+static bool rpc_send_history(void)
 {
+    const struct history_ring *ring;
+    uint8_t records[HISTORY_RING_SIZE], num_records;
+    uint16_t interval, age;
+    uint32_t pos, end;
     uint8_t i;
 
-    if (msg == NULL)
-        return;
+    // [sensor, tier, stream position]
+    if (recv_msg.len != 6 ||
+            recv_msg.data[0] >= temp_control_get_num_sensors() ||
+            recv_msg.data[1] >= HISTORY_TIERS)
+        return false;
 
-    uart_putc(RPC_SYNC_BYTE);
-    rpc_send_escaped(msg->cmd);
-    rpc_send_escaped(msg->id);
-    rpc_send_escaped(msg->len);
-    for (i = 0; i < msg->len; i++)
-        rpc_send_escaped(msg->data[i]);
-    rpc_send_escaped((msg->crc >> 8) & 0xFF);
-    rpc_send_escaped(msg->crc & 0xFF);
-    uart_putc(RPC_SYNC_BYTE);   // probably not necessary
+    ring = history_get(recv_msg.data[0], recv_msg.data[1]);
+    interval = history_get_interval(recv_msg.data[1]);
+    age = history_get_age(recv_msg.data[1]);
+    pos = ((uint32_t) recv_msg.data[2] << 24) |
+        ((uint32_t) recv_msg.data[3] << 16) |
+        ((uint32_t) recv_msg.data[4] << 8) | recv_msg.data[5];
+    end = ring->start + ring->len;
+    num_records = history_read(ring, pos, records, sizeof(records));
+
+    // [interval in s, age of the newest record in s, base value, first and
+    // end position in the ring], then the records from the requested
+    // position on
+    rpc_reply_begin(3 * sizeof(uint16_t) + 2 * sizeof(uint32_t) +
+            num_records);
+    rpc_put16(interval);
+    rpc_put16(age);
+    rpc_put16(ring->base);
+    rpc_put32(ring->start);
+    rpc_put32(end);
+
+    for (i = 0; i < num_records; i++)
+        rpc_put(records[i]);
+
+    rpc_reply_end();
+
+    return true;
+}
+
+static void rpc_send_link_stats(void)
+{
+    uint16_t tx_full = uart_get_tx_full(RPC_CHANNEL);
+    uint16_t tx_free = uart_tx_free(RPC_CHANNEL);
+    uint32_t stall_ms = stall_ticks * TICK_MS;
+
+    // [refused writes, deferred requests, ms requests waited for room for
+    // their reply, free tx bytes]
+#if UART_USE_USART1
+    rpc_reply_begin(4 * sizeof(uint16_t) + sizeof(uint32_t));
+#else
+    rpc_reply_begin(3 * sizeof(uint16_t) + sizeof(uint32_t));
+#endif
+    rpc_put16(tx_full);
+    rpc_put16(deferred_requests);
+    rpc_put32(stall_ms);
+    rpc_put16(tx_free);
+#if UART_USE_USART1
+    // [telemetry frames dropped]
+    rpc_put16(telemetry_dropped);
+#endif
+
+    rpc_reply_end();
+}
+
+static bool rpc_set_baud(void)
+{
+    uint32_t rate;
+
+    // [rate], 32 bit
+    if (recv_msg.len != sizeof(rate))
+        return false;
+
+    rate = ((uint32_t) recv_msg.data[0] << 24) |
+        ((uint32_t) recv_msg.data[1] << 16) |
+        ((uint32_t) recv_msg.data[2] << 8) | recv_msg.data[3];
+
+    if (!uart_baud_valid(rate))
+        return false;
+
+    // acked at the old rate
+    rpc_send_ack();
+    baud_next = rate;
+
+    return true;
+}
+
+static void rpc_send_baud(void)
+{
+    uint8_t i, num_rates = 0;
+    uint32_t rate = uart_get_baud(RPC_CHANNEL);
+
+    while (uart_get_baud_rate(num_rates) != 0)
+        num_rates++;
+
+    // [current rate, 0/1 confirmed], then the usable rates
+    rpc_reply_begin(sizeof(uint32_t) + 1 + num_rates * sizeof(uint32_t));
+    rpc_put32(rate);
+    rpc_put(!baud_unconfirmed);
+
+    for (i = 0; i < num_rates; i++)
+        rpc_put32(uart_get_baud_rate(i));
+
+    rpc_reply_end();
+}
+
+static bool rpc_set_alarm_monitor(void)
+{
+    // [0/1, band in degrees]
+    if (recv_msg.len != 2 || recv_msg.data[0] > 1 ||
+            !temp_control_set_alarm_monitor(recv_msg.data[0],
+                recv_msg.data[1]))
+        return false;
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static bool rpc_set_control_mode(void)
+{
+    uint8_t zone;
+
+    // 0 = on/off, 1 = pid
+    if (!rpc_take_zone(1, &zone) ||
+            !temp_control_set_mode(zone, recv_msg.data[0]))
+        return false;
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static bool rpc_set_pid(void)
+{
+    pid_gains_t gains;
+    uint16_t period;
+    uint8_t zone;
+
+    // [kp, ki, kd, output period in s], all 16 bit
+    if (!rpc_take_zone(4 * sizeof(int16_t), &zone))
+        return false;
+
+    gains.kp = ((int16_t) recv_msg.data[0] << 8) | recv_msg.data[1];
+    gains.ki = ((int16_t) recv_msg.data[2] << 8) | recv_msg.data[3];
+    gains.kd = ((int16_t) recv_msg.data[4] << 8) | recv_msg.data[5];
+    period = ((uint16_t) recv_msg.data[6] << 8) | recv_msg.data[7];
+
+    if (!temp_control_set_pid(zone, &gains, period))
+        return false;
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static bool rpc_send_pid(void)
+{
+    pid_gains_t gains;
+    uint16_t period, cycles;
+    int16_t output;
+    uint8_t zone;
+
+    if (!rpc_take_zone(0, &zone))
+        return false;
+
+    temp_control_get_pid(zone, &gains, &period);
+    output = temp_control_get_output(zone);
+    cycles = temp_control_get_pid_cycles(zone);
+
+    // [mode, kp, ki, kd, period, output, cycles of the last update]
+    rpc_reply_begin(13);
+    rpc_put(temp_control_get_mode(zone));
+    rpc_put16(gains.kp);
+    rpc_put16(gains.ki);
+    rpc_put16(gains.kd);
+    rpc_put16(period);
+    rpc_put16(output);
+    rpc_put16(cycles);
+
+    rpc_reply_end();
+
+    return true;
+}
+
+static bool rpc_autotune(void)
+{
+    int16_t hysteresis;
+    uint8_t zone;
+
+    // [0] stops, [zone, 1, hysteresis] starts, the zone is optional
+    if (recv_msg.len == 1 && recv_msg.data[0] == 0)
+    {
+        temp_control_stop_autotune();
+    }
+    else
+    {
+        if (!rpc_take_zone(1 + sizeof(int16_t), &zone) ||
+                recv_msg.data[0] != 1)
+            return false;
+
+        hysteresis = ((int16_t) recv_msg.data[1] << 8) | recv_msg.data[2];
+
+        if (!temp_control_start_autotune(zone, hysteresis))
+            return false;
+    }
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static void rpc_send_autotune(void)
+{
+    const struct autotune *tune = temp_control_get_autotune();
+
+    // [state, zone, cycles, period in s, amplitude, ku, kp, ki, kd]
+    rpc_reply_begin(15);
+    rpc_put(tune->state);
+    rpc_put(tune->zone);
+    rpc_put(tune->cycles);
+    rpc_put16(tune->period);
+    rpc_put16(tune->amplitude);
+    rpc_put16(tune->ku);
+    rpc_put16(tune->gains.kp);
+    rpc_put16(tune->gains.ki);
+    rpc_put16(tune->gains.kd);
+
+    rpc_reply_end();
+}
+
+static bool rpc_set_fan_rpm(void)
+{
+    // speed at full cooling, 0 = fixed duty cycles
+    if (recv_msg.len != sizeof(uint16_t))
+        return false;
+
+    temp_control_set_fan_rpm(((uint16_t) recv_msg.data[0] << 8) |
+            recv_msg.data[1]);
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static void rpc_send_fan(void)
+{
+    uint16_t rpm = fan_control_get_rpm();
+    uint16_t target = fan_control_get_target_rpm();
+    uint16_t on_rpm = fan_control_get_on_rpm();
+    uint16_t stalls = fan_control_get_stall_count();
+
+    // [duty, rpm, target rpm, on rpm, stalled, stall count]
+    rpc_reply_begin(10);
+    rpc_put(fan_control_get_duty());
+    rpc_put16(rpm);
+    rpc_put16(target);
+    rpc_put16(on_rpm);
+    rpc_put(fan_control_get_stalled());
+    rpc_put16(stalls);
+
+    rpc_reply_end();
+}
+
+static bool rpc_set_heating(void)
+{
+    int16_t band;
+    uint8_t zone;
+
+    // [0/1, deadband]
+    if (!rpc_take_zone(1 + sizeof(int16_t), &zone) || recv_msg.data[0] > 1)
+        return false;
+
+    band = ((int16_t) recv_msg.data[1] << 8) | recv_msg.data[2];
+
+    if (!temp_control_set_heating(zone, recv_msg.data[0], band))
+        return false;
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static bool rpc_send_heating(void)
+{
+    output_channel_t cool, heat;
+    int16_t band;
+    uint8_t zone;
+
+    if (!rpc_take_zone(0, &zone))
+        return false;
+
+    temp_control_get_zone_outputs(zone, &cool, &heat);
+
+    // [enabled, deadband, heater level in percent]
+    rpc_reply_begin(4);
+    rpc_put(temp_control_get_heating(zone, &band));
+    rpc_put16(band);
+    rpc_put((heat == OUTPUT_NONE) ? 0 :
+        heater_control_get_level(heat - OUTPUT_RELAY));
+
+    rpc_reply_end();
+
+    return true;
+}
+
+static bool rpc_set_output_limits(void)
+{
+    output_limits_t limits;
+
+    // [channel, min on s, min off s, max cycles per hour]
+    if (recv_msg.len != 6)
+        return false;
+
+    limits.min_on = ((uint16_t) recv_msg.data[1] << 8) | recv_msg.data[2];
+    limits.min_off = ((uint16_t) recv_msg.data[3] << 8) | recv_msg.data[4];
+    limits.max_cycles = recv_msg.data[5];
+
+    if (!temp_control_set_output_limits(recv_msg.data[0], &limits))
+        return false;
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static bool rpc_send_output_stats(void)
+{
+    const output_limits_t *limits;
+    output_channel_t channel;
+    uint32_t cycles, runtime;
+    if (recv_msg.len != 1 || recv_msg.data[0] >= NUM_OUTPUTS)
+        return false;
+
+    channel = recv_msg.data[0];
+    limits = output_get_limits(channel);
+    cycles = output_get_cycles(channel);
+    runtime = output_get_runtime(channel);
+
+    // [on, cycles, runtime s, min on, min off, max cycles]
+    rpc_reply_begin(14);
+    rpc_put(output_is_on(channel));
+    rpc_put32(cycles);
+    rpc_put32(runtime);
+    rpc_put16(limits->min_on);
+    rpc_put16(limits->min_off);
+    rpc_put(limits->max_cycles);
+
+    rpc_reply_end();
+
+    return true;
+}
+
+static void rpc_send_sample_ages(void)
+{
+    uint8_t i = 0;
+    uint32_t now = tick_get();
+    struct temp_sensor *sensor;
+
+    // age of every reading in ms, 0xFFFF if older or never sampled
+    rpc_reply_begin(temp_control_get_num_sensors() * sizeof(uint16_t));
+
+    while ((sensor = temp_control_get_sensor_data(i++)) != NULL)
+    {
+        uint32_t age = (now - sensor->sample_tick) * TICK_MS;
+
+        if (sensor->sample_tick == 0 || age > UINT16_MAX)
+            age = UINT16_MAX;
+
+        rpc_put16(age);
+    }
+
+    rpc_reply_end();
+}
+
+static bool rpc_rename_sensor(void)
+{
+    // sensor, name without terminating zero
+    if (recv_msg.len < 1)
+        return false;
+
+    if (!temp_control_set_sensor_name(recv_msg.data[0],
+                (const char *) &recv_msg.data[1], recv_msg.len - 1))
+        return false;
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static bool rpc_swap_sensors(void)
+{
+    if (recv_msg.len != 2)
+        return false;
+
+    if (!temp_control_swap_sensors(recv_msg.data[0], recv_msg.data[1]))
+        return false;
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static bool rpc_set_target_sensor(void)
+{
+    uint8_t zone;
+
+    if (!rpc_take_zone(1, &zone) ||
+            !temp_control_set_target_sensor(zone, recv_msg.data[0]))
+        return false;
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static bool rpc_set_predictor(void)
+{
+    uint8_t zone;
+
+    // [0/1, lag in s]
+    if (!rpc_take_zone(1 + sizeof(uint16_t), &zone) || recv_msg.data[0] > 1 ||
+            !temp_control_set_predictor(zone, recv_msg.data[0],
+                ((uint16_t) recv_msg.data[1] << 8) | recv_msg.data[2]))
+        return false;
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static bool rpc_send_predictor(void)
+{
+    uint16_t lag;
+    int16_t slope, predicted;
+    uint8_t zone;
+
+    if (!rpc_take_zone(0, &zone))
+        return false;
+
+    // [enabled, lag in s, slope per minute, predicted temperature]
+    rpc_reply_begin(7);
+    rpc_put(temp_control_get_predictor(zone, &lag, &slope,
+            &predicted));
+    rpc_put16(lag);
+    rpc_put16(slope);
+    rpc_put16(predicted);
+
+    rpc_reply_end();
+
+    return true;
+}
+
+static void rpc_send_zones(void)
+{
+    output_channel_t cool, heat;
+    uint8_t zone;
+
+    // [sensor, state, target temp, cooling channel, heating channel] per zone
+    rpc_reply_begin(MAX_ZONES * 6);
+    for (zone = 0; zone < MAX_ZONES; zone++)
+    {
+        int16_t temp = temp_control_get_target_temp(zone);
+
+        temp_control_get_zone_outputs(zone, &cool, &heat);
+
+        rpc_put(temp_control_get_target_sensor(zone));
+        rpc_put(temp_control_get_state(zone));
+        rpc_put16(temp);
+        rpc_put(cool);
+        rpc_put(heat);
+    }
+
+    rpc_reply_end();
+}
+
+static bool rpc_set_zone_outputs(void)
+{
+    // [zone, cooling channel, heating channel], 0xFF = none
+    if (recv_msg.len != 3 || recv_msg.data[0] >= MAX_ZONES ||
+            !temp_control_set_zone_outputs(recv_msg.data[0],
+                recv_msg.data[1], recv_msg.data[2]))
+        return false;
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static bool rpc_set_zone_running(void)
+{
+    // [zone, 0/1]
+    if (recv_msg.len != 2 || recv_msg.data[0] >= MAX_ZONES ||
+            recv_msg.data[1] > 1)
+        return false;
+
+    temp_control_set_running(recv_msg.data[0], recv_msg.data[1]);
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static bool rpc_set_profile(void)
+{
+    profile_segment_t segments[PROFILE_MAX_SEGMENTS];
+    uint8_t i, num_segments, data_pos = 1;
+
+    // [zone, target, duration in min, rate per hour] with up to
+    // PROFILE_MAX_SEGMENTS segments of 16 bit values
+    if (recv_msg.len < 1 || (recv_msg.len - 1) % 6 != 0)
+        return false;
+
+    num_segments = (recv_msg.len - 1) / 6;
+    if (num_segments > PROFILE_MAX_SEGMENTS)
+        return false;
+
+    for (i = 0; i < num_segments; i++)
+    {
+        segments[i].target = ((int16_t) recv_msg.data[data_pos] << 8) |
+            recv_msg.data[data_pos + 1];
+        segments[i].duration = ((uint16_t) recv_msg.data[data_pos + 2] << 8) |
+            recv_msg.data[data_pos + 3];
+        segments[i].rate = ((int16_t) recv_msg.data[data_pos + 4] << 8) |
+            recv_msg.data[data_pos + 5];
+        data_pos += 6;
+    }
+
+    if (!profile_set(recv_msg.data[0], segments, num_segments))
+        return false;
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static bool rpc_send_profile(void)
+{
+    const profile_t *profile;
+    profile_state_t state;
+    uint8_t i, segment, zone;
+    uint32_t elapsed;
+    int16_t temp;
+
+    if (recv_msg.len != 1 || recv_msg.data[0] >= MAX_ZONES)
+        return false;
+
+    zone = recv_msg.data[0];
+    profile = profile_get(zone);
+    state = profile_get_state(zone, &segment, &elapsed);
+    temp = temp_control_get_target_temp(zone);
+
+    // [state, segment, s in segment, setpoint, segments as for set]
+    rpc_reply_begin(8 + profile->num_segments * 6);
+    rpc_put(state);
+    rpc_put(segment);
+    rpc_put32(elapsed);
+    rpc_put16(temp);
+
+    for (i = 0; i < profile->num_segments; i++)
+    {
+        const profile_segment_t *seg = &profile->segments[i];
+
+        rpc_put16(seg->target);
+        rpc_put16(seg->duration);
+        rpc_put16(seg->rate);
+    }
+
+    rpc_reply_end();
+
+    return true;
+}
+
+static bool rpc_run_profile(void)
+{
+    // [zone, 0] stops, [zone, 1, first segment] starts
+    if (recv_msg.len == 2 && recv_msg.data[1] == 0)
+    {
+        if (recv_msg.data[0] >= MAX_ZONES)
+            return false;
+
+        profile_stop(recv_msg.data[0]);
+    }
+    else if (recv_msg.len != 3 || recv_msg.data[1] != 1 ||
+            !profile_start(recv_msg.data[0], recv_msg.data[2]))
+    {
+        return false;
+    }
+
+    rpc_send_ack();
+
+    return true;
+}
+
+static bool rpc_parse_message(void)
+{
+    switch (recv_msg.cmd)
+    {
+        case RPC_COMMAND_LIST_DEVICES:
+            rpc_send_devices();
+            return true;
+        case RPC_COMMAND_SET_TARGET_TEMP:
+            return rpc_set_target_temp();
+        case RPC_COMMAND_SET_RESOLUTION:
+            return rpc_set_resolution();
+        case RPC_COMMAND_SET_SAMPLE_PERIOD:
+            return rpc_set_sample_period();
+        case RPC_COMMAND_GET_SAMPLE_CONFIG:
+            rpc_send_sample_config();
+            return true;
+        case RPC_COMMAND_SET_SAMPLE_MODE:
+            return rpc_set_sample_mode();
+        case RPC_COMMAND_GET_SAMPLE_AGES:
+            rpc_send_sample_ages();
+            return true;
+        case RPC_COMMAND_RENAME_SENSOR:
+            return rpc_rename_sensor();
+        case RPC_COMMAND_SWAP_SENSORS:
+            return rpc_swap_sensors();
+        case RPC_COMMAND_SET_TARGET_SENSOR:
+            return rpc_set_target_sensor();
+        case RPC_COMMAND_SET_ALARM_MONITOR:
+            return rpc_set_alarm_monitor();
+        case RPC_COMMAND_SET_CONTROL_MODE:
+            return rpc_set_control_mode();
+        case RPC_COMMAND_SET_PID:
+            return rpc_set_pid();
+        case RPC_COMMAND_GET_PID:
+            return rpc_send_pid();
+        case RPC_COMMAND_AUTOTUNE:
+            return rpc_autotune();
+        case RPC_COMMAND_GET_AUTOTUNE:
+            rpc_send_autotune();
+            return true;
+        case RPC_COMMAND_SET_FAN_RPM:
+            return rpc_set_fan_rpm();
+        case RPC_COMMAND_GET_FAN:
+            rpc_send_fan();
+            return true;
+        case RPC_COMMAND_SET_HEATING:
+            return rpc_set_heating();
+        case RPC_COMMAND_GET_HEATING:
+            return rpc_send_heating();
+        case RPC_COMMAND_SET_OUTPUT_LIMITS:
+            return rpc_set_output_limits();
+        case RPC_COMMAND_GET_OUTPUT_STATS:
+            return rpc_send_output_stats();
+        case RPC_COMMAND_RESET_OUTPUT_STATS:
+            output_reset_stats();
+            rpc_send_ack();
+            return true;
+        case RPC_COMMAND_GET_ZONES:
+            rpc_send_zones();
+            return true;
+        case RPC_COMMAND_SET_ZONE_OUTPUTS:
+            return rpc_set_zone_outputs();
+        case RPC_COMMAND_SET_ZONE_RUNNING:
+            return rpc_set_zone_running();
+        case RPC_COMMAND_SET_PROFILE:
+            return rpc_set_profile();
+        case RPC_COMMAND_GET_PROFILE:
+            return rpc_send_profile();
+        case RPC_COMMAND_RUN_PROFILE:
+            return rpc_run_profile();
+        case RPC_COMMAND_SET_ADAPTIVE:
+            return rpc_set_adaptive();
+        case RPC_COMMAND_GET_ADAPTIVE:
+            rpc_send_adaptive();
+            return true;
+        case RPC_COMMAND_GET_READINGS:
+            rpc_send_readings();
+            return true;
+        case RPC_COMMAND_SET_FILTER:
+            return rpc_set_filter();
+        case RPC_COMMAND_SET_PREDICTOR:
+            return rpc_set_predictor();
+        case RPC_COMMAND_GET_PREDICTOR:
+            return rpc_send_predictor();
+        case RPC_COMMAND_GET_STATS:
+            return rpc_send_stats();
+        case RPC_COMMAND_RESET_STATS:
+            return rpc_reset_stats();
+        case RPC_COMMAND_SET_STATS_WINDOWS:
+            return rpc_set_stats_windows();
+        case RPC_COMMAND_GET_HISTORY:
+            return rpc_send_history();
+        case RPC_COMMAND_GET_LINK_STATS:
+            rpc_send_link_stats();
+            return true;
+        case RPC_COMMAND_SET_BAUD:
+            return rpc_set_baud();
+        case RPC_COMMAND_CONFIRM_BAUD:
+            baud_unconfirmed = false;
+            rpc_send_ack();
+            return true;
+        case RPC_COMMAND_GET_BAUD:
+            rpc_send_baud();
+            return true;
+        default:
+            break;
+    }
+
+    return false;
+}
+
+void rpc_init(void)
+{
+    uart_init(RPC_CHANNEL);
+#if UART_USE_USART1
+    uart_init(RPC_TELEMETRY_CHANNEL);
+    uart_set_baud(RPC_TELEMETRY_CHANNEL, RPC_TELEMETRY_BAUD);
+#endif
+}
+
+static rpc_state_t recv_state = WAITING_FOR_SYNC;
+static uint8_t recv_pos = 0;
+static bool recv_escape = false;
+
+// returns true once a whole frame was received
+static bool rpc_receive_byte(uint8_t byte)
+{
+    if (byte == RPC_SYNC_BYTE)
+    {
+        recv_state = COMMAND;
+        recv_pos = 0;
+        return false;
+    }
+
+    if (byte == RPC_ESCAPE_BYTE)
+    {
+        recv_escape = true;
+        return false;
+    }
+
+    if (recv_escape)
+    {
+        byte ^= RPC_ESCAPE_XOR;
+        recv_escape = false;
+    }
+
+    switch (recv_state)
+    {
+        case WAITING_FOR_SYNC:
+            break;
+        case COMMAND:
+            recv_msg.cmd = byte;
+            recv_state = ID;
+            break;
+        case ID:
+            recv_msg.id = byte;
+            recv_state = LENGTH;
+            break;
+        case LENGTH:
+            recv_msg.len = byte;
+            if (recv_msg.len > 0)
+                recv_state = DATA;
+            else
+                recv_state = CRC1;
+            break;
+        case DATA:
+            recv_msg.data[recv_pos++] = byte;
+            if (recv_pos == recv_msg.len)
+                recv_state = CRC1;
+            break;
+        case CRC1:
+            recv_msg.crc = byte << 8;
+            recv_state = CRC2;
+            break;
+        case CRC2:
+            recv_msg.crc |= byte;
+            recv_state = WAITING_FOR_SYNC;
+            return true;
+    }
+
+    return false;
+}
+
+static void rpc_update_baud(void)
+{
+    if (baud_next != 0 && !request_pending && uart_tx_idle(RPC_CHANNEL))
+    {
+        uart_set_baud(RPC_CHANNEL, baud_next);
+        baud_next = 0;
+        baud_unconfirmed = true;
+        baud_tick = tick_get();
+    }
+    else if (baud_unconfirmed &&
+            (tick_get() - baud_tick) >= BAUD_CONFIRM_TIMEOUT / TICK_MS)
+    {
+        uart_set_baud(RPC_CHANNEL, UART_DEFAULT_BAUD);
+        baud_unconfirmed = false;
+    }
+}
+
+bool rpc_process_message(void)
+{
+    const uint8_t *span;
+    uint16_t i, len;
+
+    rpc_update_baud();
+
+    // further requests queue up in the receive ring meanwhile
+    if (request_pending)
+    {
+        if (uart_tx_free(RPC_CHANNEL) < RPC_MAX_FRAME)
+            return false;
+
+        stall_ticks += tick_get() - pending_tick;
+        request_pending = false;
+
+        return rpc_parse_message();
+    }
+
+    // parse straight from the receive ring
+    while ((len = uart_rx_peek(RPC_CHANNEL, &span)) > 0)
+    {
+        for (i = 0; i < len; i++)
+        {
+            if (!rpc_receive_byte(span[i]))
+                continue;
+
+            uart_rx_commit(RPC_CHANNEL, i + 1);
+
+            if (recv_msg.crc != rpc_calculate_crc(&recv_msg))
+                return false;
+
+            if (uart_tx_free(RPC_CHANNEL) < RPC_MAX_FRAME)
+            {
+                request_pending = true;
+                pending_tick = tick_get();
+
+                if (deferred_requests != UINT16_MAX)
+                    deferred_requests++;
+
+                return false;
+            }
+
+            return rpc_parse_message();
+        }
+
+        uart_rx_commit(RPC_CHANNEL, len);
+    }
+
+    return false;
+}
+
+/* Push the readings of all sensors to the telemetry channel as
+   [temperature] per sensor, the id counts the frames. A frame that
+   might not fit is dropped. */
+void rpc_push_readings(void)
+{
+#if UART_USE_USART1
+    static uint8_t seq;
+    struct temp_sensor *sensor;
+    uint8_t i = 0;
+
+    if (!rpc_frame_begin(RPC_TELEMETRY_CHANNEL, RPC_PUSH_READINGS, seq++,
+                temp_control_get_num_sensors() * sizeof(int16_t)))
+    {
+        if (telemetry_dropped != UINT16_MAX)
+            telemetry_dropped++;
+
+        return;
+    }
+
+    while ((sensor = temp_control_get_sensor_data(i++)) != NULL)
+        rpc_put16(sensor->temp);
+
+    rpc_frame_end();
+#endif
 }
 
 uint16_t rpc_calculate_crc(const rpc_message_t *msg)
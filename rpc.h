@@ -16,7 +16,7 @@ typedef struct rpc_message_t
 
 void rpc_init(void);
 bool rpc_process_message(void);
-void rpc_send_message(const rpc_message_t *msg);
+void rpc_push_readings(void);
 uint16_t rpc_calculate_crc(const rpc_message_t *msg);
 
 
@@ -1,35 +1,140 @@
+#include <string.h>
 #include <avr/eeprom.h>
 #include <util/crc16.h>
 #include "settings.h"
+#include "fix_point.h"
 
 #define SETTINGS_MAGIC      0xA5
-#define SETTINGS_VERSION    1
+#define SETTINGS_VERSION    10
+
+/* The profile progress changes while a profile runs, it has records of
+   its own after the settings so saving it leaves the settings cells
+   alone. */
+typedef struct progress_record_t
+{
+    profile_progress_t progress;
+    uint16_t crc;
+} progress_record_t;
+
+// eeprom layout: magic, version, settings, crc, progress records
+#define SETTINGS_MAGIC_ADDR     ((uint8_t *) 0)
+#define SETTINGS_VERSION_ADDR   ((uint8_t *) 1)
+#define SETTINGS_DATA_ADDR      ((void *) 2)
+#define SETTINGS_CRC_ADDR       ((uint16_t *) (2 + sizeof(settings_t)))
+#define PROGRESS_ADDR(zone)     ((progress_record_t *) \
+            (SETTINGS_CRC_ADDR + 1) + (zone))
 
 settings_t settings;
 
+static uint16_t crc_block(uint16_t crc, const void *block, uint16_t size)
+{
+    const uint8_t *data = block;
+    uint16_t i;
+
+    for (i = 0; i < size; i++)
+        crc = _crc_ccitt_update(crc, data[i]);
+
+    return crc;
+}
+
+static uint16_t settings_crc(uint8_t magic, uint8_t version)
+{
+    uint16_t crc;
+
+    // initialize crc
+    crc = 0xFFFF;
+    crc = _crc_ccitt_update(crc, magic);
+    crc = _crc_ccitt_update(crc, version);
+
+    return crc_block(crc, &settings, sizeof(settings_t));
+}
+
+static void settings_defaults(void)
+{
+    uint8_t i;
+
+    memset(&settings, 0, sizeof(settings_t));
+
+    for (i = 0; i < MAX_ZONES; i++)
+    {
+        settings_zone_t *zone = &settings.zones[i];
+
+        zone->sensor = NO_SENSOR;
+        zone->target_temp = INT_TO_FIX(21);
+        zone->control_mode = CONTROL_BANG_BANG;
+        zone->pid_gains.kp = INT_TO_FIX(25);
+        zone->pid_gains.ki = FLOAT_TO_FIX(0.02);
+        zone->pid_gains.kd = INT_TO_FIX(60);
+        zone->output_period = DEFAULT_OUTPUT_PERIOD;
+        zone->deadband = DEFAULT_DEADBAND;
+        zone->cool_output = OUTPUT_NONE;
+        zone->heat_output = OUTPUT_NONE;
+    }
+
+    // the first zone has the first sensor, the fan and the first relay
+    settings.zones[0].sensor = 0;
+    settings.zones[0].cool_output = OUTPUT_FAN;
+    settings.zones[0].heat_output = OUTPUT_RELAY;
+}
+
 void settings_load(void)
 {
     uint8_t magic, version;
-    uint16_t crc;
 
-    magic = eeprom_read_byte(0);
-    version = eeprom_read_byte(1);
+    magic = eeprom_read_byte(SETTINGS_MAGIC_ADDR);
+    version = eeprom_read_byte(SETTINGS_VERSION_ADDR);
 
     if (magic != SETTINGS_MAGIC)
     {
         // set version to zero so all default values are loaded
         version = 0;
     }
-    else
+
+    if (version == SETTINGS_VERSION)
     {
-        // initialize crc
-        crc = 0xFFFF;
-        crc = _crc_ccitt_update(crc, magic);
-        crc = _crc_ccitt_update(crc, version);
+        eeprom_read_block(&settings, SETTINGS_DATA_ADDR, sizeof(settings_t));
+
+        if (settings_crc(magic, version) == eeprom_read_word(SETTINGS_CRC_ADDR))
+            return;
     }
 
+    settings_defaults();
 }
 
 void settings_save(void)
 {
+    eeprom_update_byte(SETTINGS_MAGIC_ADDR, SETTINGS_MAGIC);
+    eeprom_update_byte(SETTINGS_VERSION_ADDR, SETTINGS_VERSION);
+    eeprom_update_block(&settings, SETTINGS_DATA_ADDR, sizeof(settings_t));
+    eeprom_update_word(SETTINGS_CRC_ADDR,
+            settings_crc(SETTINGS_MAGIC, SETTINGS_VERSION));
+}
+
+// false and a stopped progress if the record is not valid
+bool settings_load_progress(uint8_t zone, profile_progress_t *progress)
+{
+    progress_record_t record;
+
+    eeprom_read_block(&record, PROGRESS_ADDR(zone), sizeof(record));
+
+    if (crc_block(0xFFFF, &record.progress, sizeof(record.progress)) !=
+            record.crc)
+    {
+        memset(progress, 0, sizeof(*progress));
+        return false;
+    }
+
+    *progress = record.progress;
+
+    return true;
+}
+
+// only the bytes that changed are written
+void settings_save_progress(uint8_t zone, const profile_progress_t *progress)
+{
+    progress_record_t record;
+
+    record.progress = *progress;
+    record.crc = crc_block(0xFFFF, progress, sizeof(*progress));
+    eeprom_update_block(&record, PROGRESS_ADDR(zone), sizeof(record));
 }
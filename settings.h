@@ -2,15 +2,48 @@
 #define _SETTINGS_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "temp_control.h"
+#include "pid.h"
+#include "profile.h"
 
-typedef struct settings_t
+typedef struct settings_sensor_t
+{
+    uint8_t id[OW_ROMCODE_SIZE];
+    uint8_t bus;
+    char name[SENSOR_NAME_SIZE];
+} settings_sensor_t;
+
+typedef struct settings_zone_t
 {
+    uint8_t sensor;
     int16_t target_temp;
+    uint8_t control_mode;
+    pid_gains_t pid_gains;
+    uint16_t output_period;
+    uint8_t heating_enabled;
+    int16_t deadband;
+    uint8_t cool_output;
+    uint8_t heat_output;
+    uint8_t predict;
+    uint16_t predict_lag;
+} settings_zone_t;
+
+typedef struct settings_t
+{
+    uint8_t num_sensors;
+    settings_sensor_t sensors[MAX_TEMP_SENSORS];
+    settings_zone_t zones[MAX_ZONES];
+    uint16_t fan_on_rpm;
+    output_limits_t output_limits[NUM_OUTPUTS];
+    profile_t profiles[MAX_ZONES];
 } settings_t;
 
 extern settings_t settings;
 
 void settings_load(void);
 void settings_save(void);
+bool settings_load_progress(uint8_t zone, profile_progress_t *progress);
+void settings_save_progress(uint8_t zone, const profile_progress_t *progress);
 
 #endif /* _SETTINGS_H_ */
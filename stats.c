@@ -0,0 +1,185 @@
+#include <string.h>
+#include "stats.h"
+#include "fix_point.h"
+#include "tick.h"
+
+// extra bits of the running mean
+#define STATS_MEAN_SHIFT 8
+
+// past this many samples the count and m2 are halved, older samples fade
+#define STATS_MAX_COUNT 32768
+
+static uint32_t windows[STATS_NUM_WINDOWS] = {
+    STATS_DEFAULT_WINDOW_SHORT,
+    STATS_DEFAULT_WINDOW_LONG,
+};
+
+static struct stats_entry * deque_back(struct stats_deque *dq)
+{
+    return &dq->entries[(dq->head + dq->len - 1) % STATS_BUCKETS];
+}
+
+// drop the entries that left the window
+static void deque_expire(struct stats_deque *dq, uint8_t bucket)
+{
+    while (dq->len != 0 &&
+            (uint8_t) (bucket - dq->entries[dq->head].bucket) >= STATS_BUCKETS)
+    {
+        dq->head = (dq->head + 1) % STATS_BUCKETS;
+        dq->len--;
+    }
+}
+
+/* Monotonic queue: entries the new value beats can't become the extreme
+   of the window any more, as they leave it first. The front is the
+   extreme. */
+static void deque_push(struct stats_deque *dq, uint8_t bucket, int16_t value,
+        bool max)
+{
+    deque_expire(dq, bucket);
+
+    while (dq->len != 0)
+    {
+        struct stats_entry *e = deque_back(dq);
+
+        if (max ? (e->value > value) : (e->value < value))
+        {
+            // leaves the window together with value
+            if (e->bucket == bucket)
+                return;
+
+            break;
+        }
+
+        dq->len--;
+    }
+
+    dq->len++;
+    deque_back(dq)->bucket = bucket;
+    deque_back(dq)->value = value;
+}
+
+static uint8_t current_bucket(uint8_t window)
+{
+    uint32_t seconds = tick_get() / (1000 / TICK_MS);
+
+    return seconds / (windows[window] / STATS_BUCKETS);
+}
+
+void stats_reset(struct sensor_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void stats_add(struct sensor_stats *stats, int16_t value)
+{
+    uint32_t now = tick_get();
+    int32_t x = (int32_t) value << STATS_MEAN_SHIFT;
+    int32_t delta, term;
+    uint8_t w;
+
+    // the bucket numbers wrap, so the queues must not sit idle for longer
+    // than a window
+    if (stats->count != 0)
+    {
+        for (w = 0; w < STATS_NUM_WINDOWS; w++)
+        {
+            if ((now - stats->last_tick) / (1000 / TICK_MS) >= windows[w])
+            {
+                stats->min[w].len = 0;
+                stats->max[w].len = 0;
+            }
+        }
+    }
+
+    stats->last_tick = now;
+
+    for (w = 0; w < STATS_NUM_WINDOWS; w++)
+    {
+        uint8_t bucket = current_bucket(w);
+
+        deque_push(&stats->min[w], bucket, value, false);
+        deque_push(&stats->max[w], bucket, value, true);
+    }
+
+    if (stats->count == STATS_MAX_COUNT)
+    {
+        stats->count /= 2;
+        stats->m2 /= 2;
+    }
+
+    if (stats->count++ == 0)
+        stats->mean = x;
+
+    delta = x - stats->mean;
+    stats->mean += delta / stats->count;
+
+    // both deviations in the sensor resolution, the sum in fixed point
+    term = (delta >> STATS_MEAN_SHIFT) *
+        ((x - stats->mean) >> STATS_MEAN_SHIFT);
+
+    if (term > 0)
+    {
+        term >>= FRAC_BITS;
+
+        if (stats->m2 > UINT32_MAX - term)
+            stats->m2 = UINT32_MAX;
+        else
+            stats->m2 += term;
+    }
+}
+
+int16_t stats_get_mean(const struct sensor_stats *stats)
+{
+    return stats->mean >> STATS_MEAN_SHIFT;
+}
+
+// sample variance in fixed point squared degrees
+uint32_t stats_get_variance(const struct sensor_stats *stats)
+{
+    if (stats->count < 2)
+        return 0;
+
+    return stats->m2 / (stats->count - 1);
+}
+
+// extremes over the window, false without samples in it
+bool stats_get_min_max(struct sensor_stats *stats, uint8_t window,
+        int16_t *min, int16_t *max)
+{
+    uint8_t bucket;
+
+    if (window >= STATS_NUM_WINDOWS || stats->count == 0 ||
+            (tick_get() - stats->last_tick) / (1000 / TICK_MS) >=
+            windows[window])
+        return false;
+
+    bucket = current_bucket(window);
+    deque_expire(&stats->min[window], bucket);
+    deque_expire(&stats->max[window], bucket);
+
+    if (stats->min[window].len == 0)
+        return false;
+
+    *min = stats->min[window].entries[stats->min[window].head].value;
+    *max = stats->max[window].entries[stats->max[window].head].value;
+
+    return true;
+}
+
+// the queues of all sensors have to be reset after a change
+bool stats_set_window(uint8_t window, uint32_t length)
+{
+    if (window >= STATS_NUM_WINDOWS || length < STATS_MIN_WINDOW ||
+            length > STATS_MAX_WINDOW)
+        return false;
+
+    windows[window] = length;
+
+    return true;
+}
+
+uint32_t stats_get_window(uint8_t window)
+{
+    return windows[window];
+}
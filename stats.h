@@ -0,0 +1,51 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// sliding min/max windows, their length in s
+#define STATS_NUM_WINDOWS 2
+#define STATS_DEFAULT_WINDOW_SHORT 3600UL
+#define STATS_DEFAULT_WINDOW_LONG 86400UL
+
+/* A window is split into STATS_BUCKETS buckets and slides one bucket at
+   a time, the monotonic queues hold at most one entry per bucket. */
+#define STATS_BUCKETS 12
+#define STATS_MIN_WINDOW STATS_BUCKETS
+#define STATS_MAX_WINDOW (7 * 86400UL)
+
+struct stats_entry
+{
+    uint8_t bucket;
+    int16_t value;
+};
+
+struct stats_deque
+{
+    struct stats_entry entries[STATS_BUCKETS];
+    uint8_t head;
+    uint8_t len;
+};
+
+struct sensor_stats
+{
+    // running mean and variance (Welford)
+    uint16_t count;
+    int32_t mean;           // fixed point, STATS_MEAN_SHIFT extra bits
+    uint32_t m2;            // sum of squared deviations, fixed point
+    uint32_t last_tick;
+    struct stats_deque min[STATS_NUM_WINDOWS];
+    struct stats_deque max[STATS_NUM_WINDOWS];
+};
+
+void stats_reset(struct sensor_stats *stats);
+void stats_add(struct sensor_stats *stats, int16_t value);
+int16_t stats_get_mean(const struct sensor_stats *stats);
+uint32_t stats_get_variance(const struct sensor_stats *stats);
+bool stats_get_min_max(struct sensor_stats *stats, uint8_t window,
+        int16_t *min, int16_t *max);
+bool stats_set_window(uint8_t window, uint32_t length);
+uint32_t stats_get_window(uint8_t window);
+
+#endif /* _STATS_H_ */
@@ -1,187 +1,2372 @@
 #include <avr/pgmspace.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "temp_control.h"
 #include "fan_control.h"
+#include "heater_control.h"
+#include "output.h"
 #include "ds18x20.h"
 #include "fix_point.h"
 #include "tick.h"
+#include "settings.h"
+#include "history.h"
 
 static struct temp_sensor sensors[MAX_TEMP_SENSORS];
 static uint8_t num_sensors;
-static uint8_t target_sensor = 0;
-static int16_t target_temp = INT_TO_FIX(18);
-static temp_control_state_t state = STOPPED;
 
-static void update_control_output(void)
+/* least squares slope over the last TREND_SAMPLES readings of a zone
+   sensor, taken at least TREND_INTERVAL ms apart */
+#define TREND_SAMPLES 8
+#define TREND_MIN_SAMPLES 3
+#define TREND_INTERVAL 5000
+// a longer gap restarts the trend
+#define TREND_MAX_GAP 120000UL
+
+// the lag is only learned from drifts faster than this, degrees per minute
+#define COAST_MIN_SLOPE FLOAT_TO_FIX(0.05)
+// a learned lag is saved once it moved this far from the saved one, in s,
+// but at most every LAG_SAVE_INTERVAL ms to spare the eeprom
+#define LAG_SAVE_STEP 10
+#define LAG_SAVE_INTERVAL (6UL * 3600 * 1000)
+
+struct temp_zone
+{
+    uint8_t sensor;             // control sensor, NO_SENSOR if unbound
+    int16_t target_temp;
+    temp_control_state_t state;
+
+    // pid mode: the output is time proportioned over output_period seconds
+    temp_control_mode_t mode;
+    pid_controller_t pid;
+    uint16_t output_period;
+    int16_t output;
+    uint16_t pid_cycles;
+    uint32_t sample_tick;       // last reading seen by the controller
+    uint32_t window_start;
+
+    // heating below target_temp - deadband, interlocked with cooling
+    bool heating_enabled;
+    int16_t deadband;
+
+    output_channel_t cool_output;
+    output_channel_t heat_output;
+
+    // trend of the zone sensor, the on/off mode switches off early when
+    // the temperature predicted lag seconds ahead crosses the threshold
+    int16_t trend_temp[TREND_SAMPLES];
+    uint32_t trend_tick[TREND_SAMPLES];
+    uint8_t trend_pos;
+    uint8_t trend_count;
+    int16_t slope;              // fixed point degrees per minute
+    bool predict;
+    uint16_t lag;               // s
+
+    // drift after an output switched off, from which the lag is learned
+    int8_t coast;               // -1 after cooling, 1 after heating
+    int16_t coast_slope;
+    int16_t coast_temp;
+    int16_t coast_peak;
+    uint32_t lag_save_tick;
+};
+
+static struct temp_zone zones[MAX_ZONES];
+
+// relay autotune of one zone: the cooling output is switched at target_temp
+// +/- hysteresis, the oscillation of the zone sensor gives the ultimate gain
+// and period
+#define AUTOTUNE_RELAY_AMPLITUDE INT_TO_FIX(50)
+#define AUTOTUNE_TIMEOUT (24UL * 3600 * 1000 / TICK_MS)
+static struct autotune tune;
+static int16_t tune_hysteresis;
+static bool tune_relay_on;
+static uint8_t tune_switch_ons;
+static int16_t tune_max;
+static int16_t tune_min;
+static uint32_t tune_start;
+static uint32_t tune_last_on;
+static uint32_t tune_period_sum;
+static int32_t tune_amplitude_sum;
+
+typedef enum sample_state_t
+{
+    SAMPLE_IDLE,
+    SAMPLE_CONVERTING,
+    SAMPLE_ALARM_SEARCH,
+    SAMPLE_READING,
+    SAMPLE_ARMING,
+} sample_state_t;
+
+static sample_state_t sample_state = SAMPLE_CONVERTING;
+static uint32_t conversion_time = 0;
+static uint16_t sample_period = DEFAULT_SAMPLE_PERIOD;
+// period in use, sample_period unless adaptive sampling stretches it
+static uint16_t sample_interval = DEFAULT_SAMPLE_PERIOD;
+// wait for the slowest sensor after starting a conversion, in ms
+static uint16_t conversion_wait = DS18B20_TCONV_12BIT;
+// sensors whose resolution still has to be written
+static uint16_t resolution_pending;
+// sensor being read on each bus and where to continue searching
+static uint8_t read_sensor[OW_NUM_BUSES];
+static uint8_t read_pos[OW_NUM_BUSES];
+static uint16_t read_mask;
+
+#define SENSOR_BIT(i) ((uint16_t) 1 << (i))
+
+// pipelined mode: every sensor converts on its own staggered schedule
+static bool pipelined = false;
+static bool pipelined_request = false;
+static uint32_t convert_tick[MAX_TEMP_SENSORS];
+static uint32_t next_start[MAX_TEMP_SENSORS];
+static uint16_t converting;
+static uint8_t pipe_sensor = NO_SENSOR;
+
+// adaptive sampling, aiming for ADAPTIVE_SAMPLES readings before the zone
+// temperature reaches a switching point, the minimum period is used within
+// ADAPTIVE_NEAR_BAND of one
+#define ADAPTIVE_SAMPLES 8
+#define ADAPTIVE_NEAR_BAND FLOAT_TO_FIX(0.25)
+static bool adaptive = false;
+static uint16_t adaptive_ceiling = DEFAULT_ADAPTIVE_CEILING;
+
+// the rate of change is measured over at least RATE_INTERVAL ms, a single
+// step of the sensor resolution would be too coarse
+#define RATE_INTERVAL 20000
+static int16_t rate_temp[MAX_TEMP_SENSORS];
+static uint32_t rate_tick[MAX_TEMP_SENSORS];
+
+/* Reading filter: readings outside the sensor range, the power-on value
+   and jumps are dropped, a jump that persists for FILTER_MAX_REJECTS
+   readings restarts the filter. The median of the last three readings is
+   smoothed by a moving average, kept with EMA_SHIFT extra bits. */
+#define FILTER_MIN_TEMP INT_TO_FIX(-55)
+#define FILTER_MAX_TEMP INT_TO_FIX(125)
+#define POWER_ON_TEMP INT_TO_FIX(85)
+#define FILTER_MAX_REJECTS 3
+#define EMA_SHIFT 4
+
+struct sensor_filter
+{
+    int16_t window[3];
+    uint8_t count;          // readings in the window, 0 restarts the filter
+    uint8_t pos;
+    uint8_t rejects;        // consecutive jumps
+    int32_t ema;
+};
+
+static struct sensor_filter filters[MAX_TEMP_SENSORS];
+
+// mean, variance and windowed extremes of the filtered readings
+static struct sensor_stats stats[MAX_TEMP_SENSORS];
+static uint16_t filter_alpha = DEFAULT_FILTER_ALPHA;
+static int16_t filter_max_jump = DEFAULT_FILTER_JUMP;
+
+// slots to exchange once the bus is idle
+static uint8_t swap_a = NO_SENSOR;
+static uint8_t swap_b;
+
+// background search, one rom-code per transfer
+#define NO_BUS 0xFF
+static ow_search_t scan_search;
+static uint8_t scan_bus = NO_BUS;
+static bool scan_pending = false;
+static uint16_t scan_seen;
+static uint32_t scan_tick;
+
+// alarm monitoring: secondary sensors are only read after leaving the band
+// programmed into their TH/TL registers, every few cycles all are read
+#define ALARM_REFRESH_CYCLES 12
+static bool alarm_monitor = false;
+static uint8_t alarm_band = DEFAULT_ALARM_BAND;
+static uint8_t alarm_cycles;
+static uint8_t alarm_bus;
+static bool alarm_pending = false;
+static ow_search_t alarm_search;
+// sensors whose TH/TL have to be centered on their new reading
+static uint16_t arm_mask;
+
+/* All actuator changes pass the scheduler in output.c. The fan either
+   runs at its on speed or at a level, the relays are slow PWM outputs. */
+static void drive_output(output_channel_t channel, uint8_t level, bool on_off)
+{
+    if (channel == OUTPUT_NONE)
+        return;
+
+    level = output_request(channel, level);
+
+    if (channel != OUTPUT_FAN)
+        heater_control_set_level(channel - OUTPUT_RELAY, level);
+    else if (on_off)
+        fan_control_set_on(level != 0);
+    else
+        fan_control_set_level(level);
+}
+
+static void set_cooling(struct temp_zone *zone, bool on)
+{
+    drive_output(zone->cool_output, on ? 100 : 0, true);
+}
+
+static void set_cooling_level(struct temp_zone *zone, uint8_t percent)
+{
+    drive_output(zone->cool_output, percent, false);
+}
+
+static void set_heater(struct temp_zone *zone, uint8_t percent)
+{
+    drive_output(zone->heat_output, percent, false);
+}
+
+static void outputs_off(struct temp_zone *zone)
+{
+    set_cooling(zone, false);
+    set_heater(zone, 0);
+}
+
+static bool channel_on(output_channel_t channel)
+{
+    return (channel != OUTPUT_NONE && output_is_on(channel));
+}
+
+static void update_active_state(struct temp_zone *zone)
+{
+    if (channel_on(zone->heat_output))
+        zone->state = HEATING;
+    else if (channel_on(zone->cool_output))
+        zone->state = COOLING;
+    else
+        zone->state = IDLE;
+}
+
+static bool tuning(uint8_t z)
+{
+    return (tune.state == AUTOTUNE_RUNNING && tune.zone == z);
+}
+
+// the fit indexes the ring from 0, so it has to start over there
+static void reset_trend(struct temp_zone *zone)
+{
+    zone->trend_pos = 0;
+    zone->trend_count = 0;
+    zone->slope = 0;
+    zone->coast = 0;
+}
+
+// temperature lag seconds ahead on the current trend
+static int16_t predict_temp(struct temp_zone *zone, int16_t temp)
+{
+    int32_t predicted;
+
+    if (!zone->predict || zone->trend_count < TREND_MIN_SAMPLES)
+        return temp;
+
+    predicted = temp + (int32_t) zone->slope * zone->lag / 60;
+
+    if (predicted > INT16_MAX)
+        return INT16_MAX;
+
+    if (predicted < INT16_MIN)
+        return INT16_MIN;
+
+    return predicted;
+}
+
+static void start_coast(struct temp_zone *zone, int8_t direction, int16_t temp)
+{
+    zone->coast = 0;
+
+    // the temperature has to move in the direction of the output
+    if ((direction < 0 && zone->slope > -COAST_MIN_SLOPE) ||
+            (direction > 0 && zone->slope < COAST_MIN_SLOPE))
+        return;
+
+    zone->coast = direction;
+    zone->coast_slope = zone->slope;
+    zone->coast_temp = temp;
+    zone->coast_peak = temp;
+}
+
+static void update_control_output(uint8_t z)
 {
-    if (state == STOPPED || target_sensor >= num_sensors)
+    struct temp_zone *zone = &zones[z];
+    int16_t temp, predicted, cool_off, heat_off;
+    bool cooling, heating;
+
+    if (zone->state == STOPPED)
+    {
+        outputs_off(zone);
+        zone->output = 0;
+        pid_reset(&zone->pid);
+
+        if (tuning(z))
+            tune.state = AUTOTUNE_OFF;
+        return;
+    }
+
+    if (zone->sensor >= num_sensors || !sensors[zone->sensor].online)
     {
-        fan_control_set_on(false);
-        state = STOPPED;
+        // no readings, stay off until the sensor is bound or back
+        outputs_off(zone);
+        zone->state = IDLE;
+        zone->output = 0;
+        pid_reset(&zone->pid);
+
+        if (tuning(z))
+            tune.state = AUTOTUNE_FAILED;
         return;
     }
 
-    if (sensors[target_sensor].temp > target_temp)
+    if (tuning(z))
     {
-        fan_control_set_on(true);
-        state = COOLING;
+        set_heater(zone, 0);
+        set_cooling(zone, tune_relay_on);
+        update_active_state(zone);
+        return;
     }
-    else if (sensors[target_sensor].temp < (target_temp - FLOAT_TO_FIX(0.2)))
+
+    if (zone->mode == CONTROL_PID)
     {
-        fan_control_set_on(false);
-        state = IDLE;
+        // the outputs are switched by update_output_window()
+        if (zone->output > 0)
+            zone->state = COOLING;
+        else if (zone->output < 0)
+            zone->state = HEATING;
+        else
+            zone->state = IDLE;
+        return;
     }
+
+    temp = sensors[zone->sensor].temp;
+    predicted = predict_temp(zone, temp);
+    cool_off = zone->target_temp - FLOAT_TO_FIX(0.2);
+    heat_off = zone->target_temp - zone->deadband + FLOAT_TO_FIX(0.2);
+    cooling = channel_on(zone->cool_output);
+    heating = channel_on(zone->heat_output);
+
+    // switch off first, the interlock holds back the other actuator
+    if (temp < cool_off || predicted < cool_off)
+        set_cooling(zone, false);
+
+    if (!zone->heating_enabled || temp > heat_off || predicted > heat_off)
+        set_heater(zone, 0);
+
+    // don't start an output the drift would make overshoot right away
+    if (temp > zone->target_temp && predicted >= cool_off)
+        set_cooling(zone, true);
+    else if (zone->heating_enabled &&
+            temp < (zone->target_temp - zone->deadband) &&
+            predicted <= heat_off)
+        set_heater(zone, 100);
+
+    if (cooling && !channel_on(zone->cool_output))
+        start_coast(zone, -1, temp);
+    else if (heating && !channel_on(zone->heat_output))
+        start_coast(zone, 1, temp);
+    else if (channel_on(zone->cool_output) || channel_on(zone->heat_output))
+        zone->coast = 0;
+
+    update_active_state(zone);
 }
 
-void temp_control_init(void)
+static void update_all_outputs(void)
 {
-    uint8_t i;
-
-    fan_control_init();
-    temp_control_set_running(false);
-    update_control_output();
+    uint8_t z;
 
-    ow_reset_search();
+    for (z = 0; z < MAX_ZONES; z++)
+        update_control_output(z);
+}
 
-    for (i = 0; i < MAX_TEMP_SENSORS; i++)
-    {
-        if (!DS18X20_find_sensor(sensors[i].id))
-            break;
+static uint16_t isqrt(uint32_t val)
+{
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
 
-        sensors[i].temp = 0;
-        sensors[i].min = INT16_MAX;
-        sensors[i].max = INT16_MIN;
+    while (bit > val)
+        bit >>= 2;
 
-        switch (i)
+    while (bit != 0)
+    {
+        if (val >= root + bit)
         {
-            case 0:
-                strcpy_P(sensors[i].name, PSTR("Beer"));
-                break;
-            case 1:
-                strcpy_P(sensors[i].name, PSTR("Chamber"));
-                break;
-            case 2:
-                strcpy_P(sensors[i].name, PSTR("Ice"));
-                break;
-            case 3:
-                strcpy_P(sensors[i].name, PSTR("Ambient"));
-                break;
-            default:
-                snprintf_P(sensors[i].name, 11, PSTR("Sensor %i"), i + 1);
-                break;
+            val -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
         }
-    }
 
-    num_sensors = i;
+        bit >>= 2;
+    }
 
-    if (num_sensors == 0)
-        return;
+    return root;
+}
 
-    // start first conversion
-    DS18X20_start_meas(NULL);
+static int16_t clamp_gain(uint32_t gain)
+{
+    return (gain > INT16_MAX) ? INT16_MAX : gain;
 }
 
-bool temp_control_update(void)
+/* Ziegler-Nichols gains from the averaged oscillation, the relay
+   hysteresis is taken out of the amplitude (Astrom-Hagglund) */
+static bool finish_autotune(void)
 {
-    static bool converting = true;
-    static uint32_t conversion_time = 0;
+    uint32_t tu_ms = tune_period_sum * TICK_MS / AUTOTUNE_CYCLES;
+    int16_t a = tune_amplitude_sum / AUTOTUNE_CYCLES;
+    uint16_t a_eff;
+    uint32_t kp;
+    int16_t ku;
 
-    uint8_t i;
+    tune.period = tu_ms / 1000;
+    tune.amplitude = a;
 
-    //if (num_sensors == 0 || DS18X20_conversion_in_progress())
-    if (num_sensors == 0)
+    if (a <= tune_hysteresis || tu_ms < 1000)
         return false;
 
-    if (converting)
+    a_eff = isqrt((int32_t) a * a - (int32_t) tune_hysteresis * tune_hysteresis);
+
+    // ku = 4d / (pi a), pi as 355/113
+    ku = clamp_gain((uint32_t) 4 * AUTOTUNE_RELAY_AMPLITUDE * FIX_ONE * 113 /
+        ((uint32_t) 355 * a_eff));
+    kp = (uint32_t) ku * 3 / 5;
+
+    tune.ku = ku;
+    tune.gains.kp = clamp_gain(kp);
+    // ki = kp / (tu / 2), kd = kp * tu / 8
+    tune.gains.ki = clamp_gain(kp * 2000 / tu_ms);
+    tune.gains.kd = clamp_gain(kp * (tu_ms / 1000) / 8);
+
+    return true;
+}
+
+/* relay step on a new reading: the maximum follows a switch-on, the minimum
+   a switch-off, each switch-on closes one oscillation */
+static void update_autotune(struct temp_sensor *sensor)
+{
+    struct temp_zone *zone = &zones[tune.zone];
+    int16_t target_temp = zone->target_temp;
+    int16_t temp = sensor->temp;
+    uint32_t now = sensor->sample_tick;
+
+    if ((now - tune_start) > AUTOTUNE_TIMEOUT)
     {
-        if ((tick_get() - conversion_time) < (1000 / TICK_MS))
-            return false;
-        
-        if (DS18X20_conversion_in_progress())
-            return false;
+        tune.state = AUTOTUNE_FAILED;
+        return;
+    }
+
+    if (tune_relay_on)
+    {
+        if (temp > tune_max)
+            tune_max = temp;
 
-        converting = false;
+        if (temp < target_temp - tune_hysteresis)
+        {
+            tune_relay_on = false;
+            tune_min = temp;
+        }
+
+        return;
     }
-    else
+
+    if (temp < tune_min)
+        tune_min = temp;
+
+    if (temp <= target_temp + tune_hysteresis)
+        return;
+
+    // the first complete oscillation is discarded as transient
+    if (tune_switch_ons >= 2)
     {
-        if ((tick_get() - conversion_time) >= (5000 / TICK_MS))
+        tune_period_sum += now - tune_last_on;
+        tune_amplitude_sum += (tune_max - tune_min) / 2;
+
+        if (++tune.cycles == AUTOTUNE_CYCLES)
         {
-            // start next conversion
-            DS18X20_start_meas(NULL);
-            conversion_time = tick_get();
-            converting = true;
+            tune_relay_on = false;
+
+            if (!finish_autotune() ||
+                    !temp_control_set_pid(tune.zone, &tune.gains,
+                        zone->output_period))
+            {
+                tune.state = AUTOTUNE_FAILED;
+                return;
+            }
+
+            tune.state = AUTOTUNE_DONE;
+            pid_reset(&zone->pid);
+            temp_control_set_mode(tune.zone, CONTROL_PID);
+            return;
         }
+    }
 
-        return false;
+    if (tune_switch_ons < 2)
+        tune_switch_ons++;
+
+    tune_relay_on = true;
+    tune_last_on = now;
+    tune_max = temp;
+}
+
+/* run the pid controller (or the autotune relay) on every new reading of
+   the zone sensor */
+static void update_pid(uint8_t z)
+{
+    struct temp_zone *zone = &zones[z];
+    struct temp_sensor *sensor;
+    uint16_t start;
+    uint32_t dt;
+
+    if (zone->state == STOPPED || zone->sensor >= num_sensors)
+        return;
+
+    sensor = &sensors[zone->sensor];
+    if (sensor->sample_tick == zone->sample_tick)
+        return;
+
+    dt = (sensor->sample_tick - zone->sample_tick) * TICK_MS;
+    zone->sample_tick = sensor->sample_tick;
+
+    if (tuning(z))
+    {
+        update_autotune(sensor);
+        return;
     }
 
-    for (i = 0; i < num_sensors; i++)
+    if (zone->mode != CONTROL_PID)
+        return;
+
+    if (dt > PID_MAX_DT)
+        dt = PID_MAX_DT;
+
+    start = tick_get_clocks();
+    zone->output = pid_update(&zone->pid, zone->target_temp, sensor->temp, dt);
+    zone->pid_cycles = tick_cycles_since(start);
+}
+
+/* switch the cooling output on for output percent of every output period,
+   with a period of 0 its level follows the output */
+static void update_output_window(uint8_t z)
+{
+    struct temp_zone *zone = &zones[z];
+    uint32_t now = tick_get();
+    uint32_t period = (uint32_t) zone->output_period * (1000 / TICK_MS);
+    int16_t output = zone->output;
+
+    if (zone->mode != CONTROL_PID || zone->state == STOPPED || tuning(z) ||
+            zone->sensor >= num_sensors || !sensors[zone->sensor].online)
+        return;
+
+    if (output < 0)
     {
-        DS18X20_read_fixed_point(sensors[i].id, &(sensors[i].temp));
+        // the heater runs its own 1s window
+        set_cooling(zone, false);
+        set_heater(zone, FIX_TO_NEAREST_INT(-output));
+        return;
+    }
 
-        if (sensors[i].temp < sensors[i].min)
-            sensors[i].min = sensors[i].temp;
+    set_heater(zone, 0);
 
-        if (sensors[i].temp > sensors[i].max)
-            sensors[i].max = sensors[i].temp;
+    if (period == 0)
+    {
+        // continuous airflow proportional to the output
+        set_cooling_level(zone, FIX_TO_NEAREST_INT(output));
+        return;
     }
 
-    update_control_output();
+    if ((now - zone->window_start) >= period)
+        zone->window_start = now;
 
-    return true;
+    set_cooling(zone, (now - zone->window_start) <
+            (uint32_t) output * period / PID_OUTPUT_MAX);
 }
 
-void temp_control_set_target_temp(int16_t temp)
+// negative pid outputs drive the heater, zero error within half the deadband
+static void update_pid_range(struct temp_zone *zone)
 {
-    target_temp = temp;
-    update_control_output();
+    bool heating = zone->heating_enabled;
+
+    zone->pid.out_min = heating ? -PID_OUTPUT_MAX : PID_OUTPUT_MIN;
+    zone->pid.deadband = heating ? zone->deadband / 2 : 0;
 }
 
-int16_t temp_control_get_target_temp(void)
+// sensors bound to a zone, they are read on every cycle
+static uint16_t zone_sensors(void)
 {
-    return target_temp;
+    uint16_t mask = 0;
+    uint8_t z;
+
+    for (z = 0; z < MAX_ZONES; z++)
+    {
+        if (zones[z].sensor < num_sensors)
+            mask |= SENSOR_BIT(zones[z].sensor);
+    }
+
+    return mask;
 }
 
-void temp_control_set_target_sensor(uint8_t sensor)
+// the outputs of a zone are interlocked among themselves only
+static void update_output_groups(void)
 {
-    if (sensor < num_sensors)
+    output_channel_t i;
+    uint8_t z;
+
+    for (i = 0; i < NUM_OUTPUTS; i++)
+        output_set_group(i, OUTPUT_NO_GROUP);
+
+    for (z = 0; z < MAX_ZONES; z++)
     {
-        target_sensor = sensor;
-        update_control_output();
+        output_set_group(zones[z].cool_output, z);
+        output_set_group(zones[z].heat_output, z);
     }
 }
 
-void temp_control_set_running(bool running)
+#define RESOLUTION_TO_CONF(bits) (((bits) - 9) << 5)
+#define CONF_TO_RESOLUTION(conf) ((((conf) & DS18B20_RES_MASK) >> 5) + 9)
+
+static void update_conversion_wait(void)
 {
-    if (running)
+    uint8_t i;
+
+    conversion_wait = 0;
+
+    for (i = 0; i < num_sensors; i++)
     {
-        if (state == STOPPED)
-            state = IDLE;
+        uint16_t t = DS18X20_conversion_time(sensors[i].id,
+                RESOLUTION_TO_CONF(sensors[i].resolution));
+
+        if (t > conversion_wait)
+            conversion_wait = t;
     }
-    else
+
+    if (sample_period < conversion_wait)
+        sample_period = conversion_wait;
+
+    if (sample_interval < sample_period)
+        sample_interval = sample_period;
+}
+
+// write pending resolutions, only called while the bus is idle
+static void write_resolutions(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < num_sensors; i++)
     {
-        state = STOPPED;
+        uint8_t sp[DS18X20_SP_SIZE];
+
+        if (!(resolution_pending & SENSOR_BIT(i)))
+            continue;
+
+        ow_set_bus(sensors[i].bus);
+
+        // keep the alarm registers and store in the sensor's eeprom
+        if (DS18X20_read_scratchpad(sensors[i].id, sp) == DS18X20_OK &&
+                DS18X20_write_scratchpad(sensors[i].id, sp[DS18X20_TH_REG],
+                    sp[DS18X20_TL_REG],
+                    RESOLUTION_TO_CONF(sensors[i].resolution)) == DS18X20_OK)
+            DS18X20_scratchpad_to_eeprom(sensors[i].id);
     }
 
-    update_control_output();
+    resolution_pending = 0;
+    update_conversion_wait();
 }
 
-temp_control_state_t temp_control_get_state(void)
+static void default_name(uint8_t i)
 {
-    return state;
+    switch (i)
+    {
+        case 0:
+            strcpy_P(sensors[i].name, PSTR("Beer"));
+            break;
+        case 1:
+            strcpy_P(sensors[i].name, PSTR("Chamber"));
+            break;
+        case 2:
+            strcpy_P(sensors[i].name, PSTR("Ice"));
+            break;
+        case 3:
+            strcpy_P(sensors[i].name, PSTR("Ambient"));
+            break;
+        default:
+            snprintf_P(sensors[i].name, SENSOR_NAME_SIZE, PSTR("Sensor %i"),
+                    i + 1);
+            break;
+    }
 }
 
-uint8_t temp_control_get_num_sensors(void)
+/* reset the readings and fetch the resolution, returns false if the sensor
+   did not answer with a valid scratchpad */
+static bool init_sensor(uint8_t i)
 {
-    return num_sensors;
+    uint8_t sp[DS18X20_SP_SIZE];
+
+    sensors[i].resolution = 12;
+    sensors[i].online = false;
+    sensors[i].raw = 0;
+    sensors[i].temp = 0;
+    sensors[i].rejects = 0;
+    sensors[i].rate = 0;
+    filters[i].count = 0;
+    sensors[i].sample_tick = 0;
+    rate_tick[i] = 0;
+    stats_reset(&stats[i]);
+    history_reset(i);
+
+    ow_set_bus(sensors[i].bus);
+
+    if (DS18X20_read_scratchpad(sensors[i].id, sp) != DS18X20_OK)
+        return false;
+
+    if (DS18X20_resolution_supported(sensors[i].id))
+        sensors[i].resolution = CONF_TO_RESOLUTION(sp[DS18B20_CONF_REG]);
+
+    sensors[i].online = true;
+
+    return true;
 }
 
-struct temp_sensor * temp_control_get_sensor_data(uint8_t sensor)
+static void save_sensor_table(void)
 {
-    if (sensor < num_sensors)
-        return &sensors[sensor];
+    uint8_t i;
 
-    return NULL;
+    for (i = 0; i < num_sensors; i++)
+    {
+        memcpy(settings.sensors[i].id, sensors[i].id, OW_ROMCODE_SIZE);
+        settings.sensors[i].bus = sensors[i].bus;
+        memcpy(settings.sensors[i].name, sensors[i].name, SENSOR_NAME_SIZE);
+    }
+
+    for (i = 0; i < MAX_ZONES; i++)
+        settings.zones[i].sensor = zones[i].sensor;
+
+    settings.num_sensors = num_sensors;
+    settings_save();
+}
+
+/* use the sensor table from eeprom if every sensor in it answers,
+   a matched scratchpad read is much cheaper than a full rom search */
+static bool load_sensor_table(void)
+{
+    uint8_t i;
+
+    if (settings.num_sensors == 0 || settings.num_sensors > MAX_TEMP_SENSORS)
+        return false;
+
+    for (i = 0; i < settings.num_sensors; i++)
+    {
+        memcpy(sensors[i].id, settings.sensors[i].id, OW_ROMCODE_SIZE);
+        sensors[i].bus = settings.sensors[i].bus;
+        memcpy(sensors[i].name, settings.sensors[i].name, SENSOR_NAME_SIZE);
+        sensors[i].name[SENSOR_NAME_SIZE - 1] = '\0';
+
+        if (sensors[i].bus >= OW_NUM_BUSES || !init_sensor(i))
+            return false;
+    }
+
+    num_sensors = settings.num_sensors;
+
+    return true;
+}
+
+static void add_sensor(const uint8_t *id, uint8_t bus, const char *name)
+{
+    uint8_t i = num_sensors++;
+
+    memcpy(sensors[i].id, id, OW_ROMCODE_SIZE);
+    sensors[i].bus = bus;
+
+    if (name != NULL)
+    {
+        memcpy(sensors[i].name, name, SENSOR_NAME_SIZE);
+        sensors[i].name[SENSOR_NAME_SIZE - 1] = '\0';
+    }
+    else
+    {
+        default_name(i);
+    }
+
+    init_sensor(i);
 }
 
+/* Full search of all buses. Known sensors keep their slot, name and role,
+   those that did not answer stay as offline placeholders until the rescan
+   finds them again. New ones are appended so they can't take over a zone
+   sensor. Returns true if the table differs from the saved one. */
+static bool search_sensors(void)
+{
+    uint8_t found_id[MAX_TEMP_SENSORS][OW_ROMCODE_SIZE];
+    uint8_t found_bus[MAX_TEMP_SENSORS];
+    uint8_t bus, i, j, num_found = 0;
+    uint16_t used = 0;
+    bool changed = false;
+
+    for (bus = 0; bus < OW_NUM_BUSES; bus++)
+    {
+        ow_set_bus(bus);
+        ow_reset_search();
+
+        while (num_found < MAX_TEMP_SENSORS &&
+                DS18X20_find_sensor(found_id[num_found]))
+            found_bus[num_found++] = bus;
+    }
+
+    num_sensors = 0;
+
+    if (settings.num_sensors <= MAX_TEMP_SENSORS)
+        num_sensors = settings.num_sensors;
+
+    for (i = 0; i < num_sensors; i++)
+    {
+        memcpy(sensors[i].id, settings.sensors[i].id, OW_ROMCODE_SIZE);
+        sensors[i].bus = settings.sensors[i].bus;
+        memcpy(sensors[i].name, settings.sensors[i].name, SENSOR_NAME_SIZE);
+        sensors[i].name[SENSOR_NAME_SIZE - 1] = '\0';
+
+        for (j = 0; j < num_found; j++)
+        {
+            if (!(used & SENSOR_BIT(j)) && memcmp(found_id[j],
+                        sensors[i].id, OW_ROMCODE_SIZE) == 0)
+            {
+                if (sensors[i].bus != found_bus[j])
+                    changed = true;
+
+                sensors[i].bus = found_bus[j];
+                used |= SENSOR_BIT(j);
+                break;
+            }
+        }
+
+        if (sensors[i].bus >= OW_NUM_BUSES)
+        {
+            sensors[i].bus = 0;
+            changed = true;
+        }
+
+        // offline if it was not found, like a sensor the rescan missed
+        init_sensor(i);
+    }
+
+    for (j = 0; j < num_found && num_sensors < MAX_TEMP_SENSORS; j++)
+    {
+        if (!(used & SENSOR_BIT(j)))
+        {
+            add_sensor(found_id[j], found_bus[j], NULL);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+static void start_pipeline(void);
+
+static void swap_sensors(void)
+{
+    struct temp_sensor tmp;
+    struct sensor_filter tmp_filter;
+    struct sensor_stats tmp_stats;
+    uint8_t z, a = swap_a, b = swap_b;
+    uint16_t pending_a = resolution_pending & SENSOR_BIT(a);
+    uint16_t pending_b = resolution_pending & SENSOR_BIT(b);
+    uint16_t seen_a = scan_seen & SENSOR_BIT(a);
+    uint16_t seen_b = scan_seen & SENSOR_BIT(b);
+
+    tmp = sensors[a];
+    sensors[a] = sensors[b];
+    sensors[b] = tmp;
+
+    tmp_filter = filters[a];
+    filters[a] = filters[b];
+    filters[b] = tmp_filter;
+
+    tmp_stats = stats[a];
+    stats[a] = stats[b];
+    stats[b] = tmp_stats;
+
+    history_swap(a, b);
+
+    resolution_pending &= ~(pending_a | pending_b);
+    if (pending_a)
+        resolution_pending |= SENSOR_BIT(b);
+    if (pending_b)
+        resolution_pending |= SENSOR_BIT(a);
+
+    // a rescan pass may be running, its results follow the sensors
+    scan_seen &= ~(seen_a | seen_b);
+    if (seen_a)
+        scan_seen |= SENSOR_BIT(b);
+    if (seen_b)
+        scan_seen |= SENSOR_BIT(a);
+
+    swap_a = NO_SENSOR;
+    save_sensor_table();
+
+    // a former zone sensor has no alarm band yet
+    alarm_cycles = ALARM_REFRESH_CYCLES;
+    arm_mask = 0;
+
+    // restart the rate measurements and the trends of the moved sensors
+    rate_tick[a] = 0;
+    rate_tick[b] = 0;
+
+    for (z = 0; z < MAX_ZONES; z++)
+    {
+        if (zones[z].sensor == a || zones[z].sensor == b)
+            reset_trend(&zones[z]);
+    }
+
+    // drop the schedule, it is indexed by slot
+    if (pipelined)
+        start_pipeline();
+    else if (sample_state != SAMPLE_IDLE && sample_state != SAMPLE_CONVERTING)
+        sample_state = SAMPLE_IDLE;
+}
+
+/* smoothed rate of change in degrees per minute, from the readings at
+   least RATE_INTERVAL apart */
+static void update_rate(uint8_t i, uint32_t now)
+{
+    struct temp_sensor *sensor = &sensors[i];
+    uint32_t dt = (now - rate_tick[i]) * TICK_MS;
+    int32_t rate;
+
+    if (rate_tick[i] == 0)
+    {
+        sensor->rate = 0;
+        rate_temp[i] = sensor->temp;
+        rate_tick[i] = now;
+        return;
+    }
+
+    if (dt < RATE_INTERVAL)
+        return;
+
+    rate = (int32_t) (sensor->temp - rate_temp[i]) * 60000 / (int32_t) dt;
+
+    if (rate > INT16_MAX)
+        rate = INT16_MAX;
+    else if (rate < -INT16_MAX)
+        rate = -INT16_MAX;
+
+    sensor->rate += (rate - sensor->rate) / 2;
+    rate_temp[i] = sensor->temp;
+    rate_tick[i] = now;
+}
+
+static int16_t median3(int16_t a, int16_t b, int16_t c)
+{
+    if (a > b)
+    {
+        int16_t t = a;
+        a = b;
+        b = t;
+    }
+
+    if (c < a)
+        return a;
+
+    return (c < b) ? c : b;
+}
+
+// run the raw reading through the filter, false if it was dropped
+static bool filter_reading(uint8_t i)
+{
+    struct temp_sensor *sensor = &sensors[i];
+    struct sensor_filter *f = &filters[i];
+    int16_t raw = sensor->raw;
+    int16_t median;
+    bool jump;
+
+    if (raw < FILTER_MIN_TEMP || raw > FILTER_MAX_TEMP)
+    {
+        sensor->rejects++;
+        return false;
+    }
+
+    jump = (f->count != 0 &&
+            labs((int32_t) raw - sensor->temp) > filter_max_jump);
+
+    // a sensor reports 85.0 when read before its first conversion
+    if (raw == POWER_ON_TEMP && (f->count == 0 || jump))
+    {
+        sensor->rejects++;
+        return false;
+    }
+
+    if (jump)
+    {
+        sensor->rejects++;
+
+        if (++f->rejects < FILTER_MAX_REJECTS)
+            return false;
+
+        // the change is real
+        f->count = 0;
+    }
+
+    f->rejects = 0;
+
+    if (f->count == 0)
+    {
+        f->pos = 0;
+        f->ema = (int32_t) raw << EMA_SHIFT;
+    }
+
+    f->window[f->pos] = raw;
+    f->pos = (f->pos + 1) % 3;
+    if (f->count < 3)
+        f->count++;
+
+    median = (f->count < 3) ? raw :
+        median3(f->window[0], f->window[1], f->window[2]);
+
+    f->ema += ((((int32_t) median << EMA_SHIFT) - f->ema) *
+            (int32_t) filter_alpha) >> 8;
+    sensor->temp = (f->ema + (1 << (EMA_SHIFT - 1))) >> EMA_SHIFT;
+
+    return true;
+}
+
+// account a reading, returns false if the filter dropped it
+static bool store_reading(uint8_t i)
+{
+    struct temp_sensor *sensor = &sensors[i];
+
+    if (!filter_reading(i))
+        return false;
+
+    sensor->sample_tick = tick_get();
+    update_rate(i, sensor->sample_tick);
+    stats_add(&stats[i], sensor->temp);
+
+    return true;
+}
+
+// queue the next sensor of every bus, returns false when all are read
+static bool start_parallel_read(void)
+{
+    uint8_t bus, i;
+    bool queued = false;
+
+    for (bus = 0; bus < OW_NUM_BUSES; bus++)
+    {
+        for (i = read_pos[bus]; i < num_sensors; i++)
+        {
+            if (sensors[i].bus == bus && (read_mask & SENSOR_BIT(i)))
+                break;
+        }
+
+        read_sensor[bus] = NO_SENSOR;
+        read_pos[bus] = i + 1;
+
+        // a read that was not queued leaves the result of the last one
+        if (i < num_sensors &&
+                DS18X20_read_fixed_point_async(bus, sensors[i].id,
+                    &(sensors[i].raw)) == DS18X20_OK)
+        {
+            read_sensor[bus] = i;
+            queued = true;
+        }
+    }
+
+    if (queued)
+        DS18X20_async_run();
+
+    return queued;
+}
+
+// a search step has finished, returns true if the sensor table changed
+static bool rescan_result(void)
+{
+    uint8_t id[OW_ROMCODE_SIZE];
+    uint8_t i;
+
+    scan_pending = false;
+
+    if (!ow_async_search_result(&scan_search, id) || !DS18X20_is_sensor(id))
+        return false;
+
+    for (i = 0; i < num_sensors; i++)
+    {
+        if (memcmp(sensors[i].id, id, OW_ROMCODE_SIZE) == 0)
+        {
+            scan_seen |= SENSOR_BIT(i);
+            return false;
+        }
+    }
+
+    if (num_sensors >= MAX_TEMP_SENSORS)
+        return false;
+
+    // new sensor, converted from the next sample on
+    add_sensor(id, scan_bus, NULL);
+    scan_seen |= SENSOR_BIT(num_sensors - 1);
+    next_start[num_sensors - 1] = tick_get();
+    update_conversion_wait();
+    save_sensor_table();
+
+    return true;
+}
+
+/* Start the next search step while the bus is otherwise idle. After a pass
+   over all buses the sensors not found are marked offline. Returns true if
+   the sensor table changed. */
+static bool rescan_step(void)
+{
+    bool changed = false;
+    uint8_t i;
+
+    if (scan_bus == NO_BUS)
+    {
+        if ((tick_get() - scan_tick) < (RESCAN_PERIOD / TICK_MS))
+            return false;
+
+        scan_bus = 0;
+        scan_seen = 0;
+        ow_async_search_reset(&scan_search);
+    }
+
+    while (scan_bus < OW_NUM_BUSES)
+    {
+        if (ow_async_search(scan_bus, &scan_search, false))
+        {
+            scan_pending = true;
+            return false;
+        }
+
+        scan_bus++;
+        ow_async_search_reset(&scan_search);
+    }
+
+    for (i = 0; i < num_sensors; i++)
+    {
+        bool online = ((scan_seen & SENSOR_BIT(i)) != 0);
+
+        if (sensors[i].online != online)
+        {
+            sensors[i].online = online;
+            changed = true;
+        }
+    }
+
+    scan_bus = NO_BUS;
+    scan_tick = tick_get();
+
+    if (changed)
+        update_all_outputs();
+
+    return changed;
+}
+
+// true if a zone other than z drives the channel
+static bool channel_taken(output_channel_t channel, uint8_t z)
+{
+    uint8_t i;
+
+    if (channel == OUTPUT_NONE)
+        return false;
+
+    for (i = 0; i < MAX_ZONES; i++)
+    {
+        if (i != z && (zones[i].cool_output == channel ||
+                    zones[i].heat_output == channel))
+            return true;
+    }
+
+    return false;
+}
+
+/* cooling may use the fan or a relay, heating a relay, no channel is
+   shared with another zone */
+static bool valid_outputs(uint8_t z, output_channel_t cool,
+        output_channel_t heat)
+{
+    if (cool != OUTPUT_NONE && cool >= NUM_OUTPUTS)
+        return false;
+
+    if (heat != OUTPUT_NONE && (heat < OUTPUT_RELAY || heat >= NUM_OUTPUTS))
+        return false;
+
+    if (cool == heat && cool != OUTPUT_NONE)
+        return false;
+
+    return !channel_taken(cool, z) && !channel_taken(heat, z);
+}
+
+/* a pid output period of 0 drives the cooling level directly, a relay
+   would then bypass its minimum on and off times */
+static bool valid_period(output_channel_t cool, uint16_t period)
+{
+    if (period == 0)
+        return (cool == OUTPUT_NONE || cool == OUTPUT_FAN);
+
+    return (period >= MIN_OUTPUT_PERIOD && period <= MAX_OUTPUT_PERIOD);
+}
+
+static void load_zone(uint8_t z)
+{
+    const settings_zone_t *cfg = &settings.zones[z];
+    struct temp_zone *zone = &zones[z];
+
+    zone->target_temp = cfg->target_temp;
+    zone->state = STOPPED;
+
+    zone->mode = cfg->control_mode;
+    if (zone->mode != CONTROL_PID)
+        zone->mode = CONTROL_BANG_BANG;
+
+    zone->predict = cfg->predict;
+    zone->lag = cfg->predict_lag;
+    if (zone->lag > MAX_PREDICT_LAG)
+        zone->lag = 0;
+
+    zone->heating_enabled = cfg->heating_enabled;
+    zone->deadband = cfg->deadband;
+    if (zone->deadband < MIN_DEADBAND || zone->deadband > MAX_DEADBAND)
+        zone->deadband = DEFAULT_DEADBAND;
+
+    // the zones before this one are loaded already
+    zone->cool_output = OUTPUT_NONE;
+    zone->heat_output = OUTPUT_NONE;
+    if (valid_outputs(z, cfg->cool_output, cfg->heat_output))
+    {
+        zone->cool_output = cfg->cool_output;
+        zone->heat_output = cfg->heat_output;
+    }
+
+    zone->output_period = cfg->output_period;
+    if (!valid_period(zone->cool_output, zone->output_period))
+        zone->output_period = DEFAULT_OUTPUT_PERIOD;
+
+    // cooling output, more output lowers the temperature
+    pid_init(&zone->pid, &cfg->pid_gains, true);
+    update_pid_range(zone);
+}
+
+void temp_control_init(void)
+{
+    bool table_changed = false;
+    uint8_t z;
+
+    fan_control_init();
+    heater_control_init();
+    ow_init();
+
+    fan_control_set_on_rpm(settings.fan_on_rpm);
+
+    for (z = 0; z < MAX_ZONES; z++)
+        load_zone(z);
+
+    output_init(settings.output_limits);
+    update_output_groups();
+    update_all_outputs();
+
+    if (!load_sensor_table())
+        table_changed = search_sensors();
+
+    /* A zone whose sensor is missing stays unbound until the host binds
+       it again, fresh settings bind the first zone to the first slot. */
+    for (z = 0; z < MAX_ZONES; z++)
+    {
+        zones[z].sensor = settings.zones[z].sensor;
+
+        if (zones[z].sensor >= num_sensors)
+            zones[z].sensor = NO_SENSOR;
+    }
+
+    if (table_changed)
+        save_sensor_table();
+
+    scan_tick = tick_get();
+
+    if (num_sensors == 0)
+    {
+        // wait for sensors to show up
+        sample_state = SAMPLE_IDLE;
+        return;
+    }
+
+    update_conversion_wait();
+
+    // start first conversion on all buses
+    ow_set_bus(OW_ALL_BUSES);
+    DS18X20_start_meas(NULL);
+    conversion_time = tick_get();
+}
+
+static uint16_t online_sensors(void)
+{
+    uint16_t mask = 0;
+    uint8_t i;
+
+    for (i = 0; i < num_sensors; i++)
+    {
+        if (sensors[i].online)
+            mask |= SENSOR_BIT(i);
+    }
+
+    return mask;
+}
+
+static void start_read(void)
+{
+    uint8_t bus;
+
+    for (bus = 0; bus < OW_NUM_BUSES; bus++)
+        read_pos[bus] = 0;
+
+    // nothing to read if all sensors are offline
+    if (start_parallel_read())
+        sample_state = SAMPLE_READING;
+    else
+        sample_state = SAMPLE_IDLE;
+}
+
+/* Collect the sensors in alarm with one search step per call, then read
+   them along with the zone sensors. */
+static void update_alarm_search(void)
+{
+    uint8_t id[OW_ROMCODE_SIZE];
+    uint8_t i;
+
+    if (alarm_pending && ow_async_search_result(&alarm_search, id))
+    {
+        for (i = 0; i < num_sensors; i++)
+        {
+            if (memcmp(sensors[i].id, id, OW_ROMCODE_SIZE) == 0)
+            {
+                read_mask |= SENSOR_BIT(i);
+                break;
+            }
+        }
+    }
+
+    alarm_pending = false;
+
+    while (alarm_bus < OW_NUM_BUSES)
+    {
+        if (ow_async_search(alarm_bus, &alarm_search, true))
+        {
+            alarm_pending = true;
+            return;
+        }
+
+        alarm_bus++;
+        ow_async_search_reset(&alarm_search);
+    }
+
+    start_read();
+}
+
+static int8_t clamp_alarm_temp(int16_t t)
+{
+    if (t < -55)
+        return -55;
+
+    if (t > 125)
+        return 125;
+
+    return t;
+}
+
+/* center TH/TL of one sensor on its last reading, the sensor compares the
+   integer part of the temperature */
+static bool arm_next_sensor(void)
+{
+    uint8_t i;
+    int16_t t;
+
+    for (i = 0; i < num_sensors; i++)
+    {
+        if (arm_mask & SENSOR_BIT(i))
+            break;
+    }
+
+    if (i == num_sensors)
+        return false;
+
+    arm_mask &= ~SENSOR_BIT(i);
+    t = sensors[i].temp >> FRAC_BITS;
+
+    DS18X20_write_scratchpad_async(sensors[i].bus, sensors[i].id,
+            clamp_alarm_temp(t + alarm_band), clamp_alarm_temp(t - alarm_band),
+            RESOLUTION_TO_CONF(sensors[i].resolution));
+
+    return true;
+}
+
+static bool update_broadcast(void)
+{
+    uint8_t bus;
+
+    switch (sample_state)
+    {
+        case SAMPLE_IDLE:
+            if (resolution_pending)
+                write_resolutions();
+
+            if ((tick_get() - conversion_time) >= (sample_interval / TICK_MS))
+            {
+                // start next conversion
+                DS18X20_start_meas_async(OW_ALL_BUSES, NULL);
+                conversion_time = tick_get();
+                sample_state = SAMPLE_CONVERTING;
+            }
+            break;
+
+        case SAMPLE_CONVERTING:
+            if ((tick_get() - conversion_time) <
+                    ((conversion_wait + TICK_MS - 1) / TICK_MS))
+                break;
+
+            // busy as long as any bus holds the line low
+            ow_set_bus(OW_ALL_BUSES);
+            if (DS18X20_conversion_in_progress())
+                break;
+
+            if (alarm_monitor && ++alarm_cycles < ALARM_REFRESH_CYCLES)
+            {
+                read_mask = zone_sensors() & online_sensors();
+                alarm_bus = 0;
+                alarm_pending = false;
+                ow_async_search_reset(&alarm_search);
+                sample_state = SAMPLE_ALARM_SEARCH;
+                update_alarm_search();
+                break;
+            }
+
+            alarm_cycles = 0;
+            read_mask = online_sensors();
+            start_read();
+            break;
+
+        case SAMPLE_ALARM_SEARCH:
+            update_alarm_search();
+            break;
+
+        case SAMPLE_READING:
+            // the reads of the last batch have completed
+            for (bus = 0; bus < OW_NUM_BUSES; bus++)
+            {
+                if (read_sensor[bus] < num_sensors &&
+                        DS18X20_async_result(bus) == DS18X20_OK &&
+                        store_reading(read_sensor[bus]))
+                {
+                    if (alarm_monitor &&
+                            !(zone_sensors() & SENSOR_BIT(read_sensor[bus])))
+                        arm_mask |= SENSOR_BIT(read_sensor[bus]);
+                }
+            }
+
+            if (start_parallel_read())
+                break;
+
+            sample_state = SAMPLE_ARMING;
+            return true;
+
+        case SAMPLE_ARMING:
+            // one TH/TL write per transfer
+            if (!arm_next_sensor())
+                sample_state = SAMPLE_IDLE;
+            break;
+    }
+
+    return false;
+}
+
+static void start_pipeline(void)
+{
+    uint32_t now = tick_get();
+    uint8_t i;
+
+    // spread the conversions evenly over one sample period
+    for (i = 0; i < num_sensors; i++)
+    {
+        next_start[i] = now +
+            ((uint32_t) sample_interval * i / num_sensors) / TICK_MS;
+    }
+
+    converting = 0;
+    pipe_sensor = NO_SENSOR;
+}
+
+/* One transfer per call: read a sensor whose conversion has finished,
+   otherwise start the next scheduled conversion. Reading one sensor
+   overlaps with the conversions of the others. */
+static bool update_pipelined(void)
+{
+    uint32_t now = tick_get();
+    uint32_t period = sample_interval / TICK_MS;
+    bool new_temp = false;
+    uint8_t i;
+
+    if (pipe_sensor != NO_SENSOR)
+    {
+        if (DS18X20_async_result(sensors[pipe_sensor].bus) == DS18X20_OK &&
+                store_reading(pipe_sensor))
+            new_temp = true;
+
+        pipe_sensor = NO_SENSOR;
+    }
+
+    if (resolution_pending)
+    {
+        // conversions of these sensors are restarted
+        converting &= ~resolution_pending;
+        write_resolutions();
+        return new_temp;
+    }
+
+    for (i = 0; i < num_sensors; i++)
+    {
+        uint16_t tconv;
+
+        if (!(converting & SENSOR_BIT(i)))
+            continue;
+
+        tconv = DS18X20_conversion_time(sensors[i].id,
+                RESOLUTION_TO_CONF(sensors[i].resolution));
+
+        if ((now - convert_tick[i]) < ((tconv + TICK_MS - 1) / TICK_MS))
+            continue;
+
+        converting &= ~SENSOR_BIT(i);
+
+        if (DS18X20_read_fixed_point_async(sensors[i].bus, sensors[i].id,
+                    &(sensors[i].raw)) == DS18X20_OK &&
+                DS18X20_async_run() == DS18X20_OK)
+            pipe_sensor = i;
+
+        return new_temp;
+    }
+
+    for (i = 0; i < num_sensors; i++)
+    {
+        if ((converting & SENSOR_BIT(i)) || !sensors[i].online ||
+                (int32_t) (now - next_start[i]) < 0)
+            continue;
+
+        // keep the stagger, but don't try to catch up after a stall
+        next_start[i] += period;
+        if ((int32_t) (now - next_start[i]) >= 0)
+            next_start[i] = now + period;
+
+        if (DS18X20_start_meas_async(sensors[i].bus, sensors[i].id) ==
+                DS18X20_OK)
+        {
+            convert_tick[i] = now;
+            converting |= SENSOR_BIT(i);
+        }
+
+        break;
+    }
+
+    return new_temp;
+}
+
+// channels given up by a zone switch off once their minimum on time is over
+static void release_outputs(void)
+{
+    output_channel_t i;
+
+    for (i = 0; i < NUM_OUTPUTS; i++)
+    {
+        if (output_is_on(i) && !channel_taken(i, NO_ZONE))
+            drive_output(i, 0, true);
+    }
+}
+
+// least squares slope of the trend samples in degrees per minute
+static int16_t trend_slope(struct temp_zone *zone)
+{
+    uint8_t n = zone->trend_count;
+    uint8_t newest = (zone->trend_pos + TREND_SAMPLES - 1) % TREND_SAMPLES;
+    int16_t x[TREND_SAMPLES];
+    int32_t sum_x = 0, sum_y = 0, sxx = 0, sxy = 0, slope;
+    uint8_t i;
+
+    // seconds before the newest sample, the window spans a few minutes
+    for (i = 0; i < n; i++)
+    {
+        x[i] = -(int16_t) ((zone->trend_tick[newest] - zone->trend_tick[i]) /
+                (1000 / TICK_MS));
+        sum_x += x[i];
+        sum_y += zone->trend_temp[i];
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        int32_t dx = x[i] - sum_x / n;
+        int32_t dy = zone->trend_temp[i] - sum_y / n;
+
+        sxx += dx * dx;
+        sxy += dx * dy;
+    }
+
+    if (sxx == 0)
+        return 0;
+
+    if (labs(sxy) < INT32_MAX / 60)
+        slope = sxy * 60 / sxx;
+    else
+        slope = sxy / sxx * 60;
+
+    if (slope > INT16_MAX)
+        return INT16_MAX;
+
+    if (slope < -INT16_MAX)
+        return -INT16_MAX;
+
+    return slope;
+}
+
+/* The drift after an output switched off ends when the trend turns. The
+   lag is the time the drift would have taken at the slope seen at switch
+   off, the estimate follows it slowly. */
+static void update_coast(uint8_t z, int16_t temp)
+{
+    struct temp_zone *zone = &zones[z];
+    uint32_t drift, lag;
+
+    if (zone->coast < 0)
+    {
+        if (temp < zone->coast_peak)
+            zone->coast_peak = temp;
+
+        if (zone->slope < 0)
+            return;
+    }
+    else if (zone->coast > 0)
+    {
+        if (temp > zone->coast_peak)
+            zone->coast_peak = temp;
+
+        if (zone->slope > 0)
+            return;
+    }
+    else
+    {
+        return;
+    }
+
+    zone->coast = 0;
+
+    drift = labs((int32_t) zone->coast_peak - zone->coast_temp);
+    lag = drift * 60 / abs(zone->coast_slope);
+
+    if (lag > MAX_PREDICT_LAG)
+        lag = MAX_PREDICT_LAG;
+
+    zone->lag = ((int32_t) zone->lag * 3 + lag) / 4;
+
+    if (abs((int16_t) (zone->lag - settings.zones[z].predict_lag)) >=
+            LAG_SAVE_STEP &&
+            tick_get() - zone->lag_save_tick >= LAG_SAVE_INTERVAL / TICK_MS)
+    {
+        zone->lag_save_tick = tick_get();
+        settings.zones[z].predict_lag = zone->lag;
+        settings_save();
+    }
+}
+
+// add new readings of the zone sensor to the trend
+static void update_trend(uint8_t z)
+{
+    struct temp_zone *zone = &zones[z];
+    struct temp_sensor *sensor;
+    uint8_t newest = (zone->trend_pos + TREND_SAMPLES - 1) % TREND_SAMPLES;
+
+    if (zone->sensor >= num_sensors)
+        return;
+
+    sensor = &sensors[zone->sensor];
+
+    if (zone->trend_count != 0 && (sensor->sample_tick -
+                zone->trend_tick[newest]) > TREND_MAX_GAP / TICK_MS)
+        reset_trend(zone);
+
+    if (sensor->sample_tick == 0 || (zone->trend_count != 0 &&
+                (sensor->sample_tick - zone->trend_tick[newest]) <
+                TREND_INTERVAL / TICK_MS))
+        return;
+
+    zone->trend_temp[zone->trend_pos] = sensor->temp;
+    zone->trend_tick[zone->trend_pos] = sensor->sample_tick;
+    zone->trend_pos = (zone->trend_pos + 1) % TREND_SAMPLES;
+    if (zone->trend_count < TREND_SAMPLES)
+        zone->trend_count++;
+
+    if (zone->trend_count < TREND_MIN_SAMPLES)
+        return;
+
+    zone->slope = trend_slope(zone);
+    update_coast(z, sensor->temp);
+}
+
+// ms until the zone temperature reaches a switching point
+static uint32_t zone_sample_period(uint8_t z)
+{
+    struct temp_zone *zone = &zones[z];
+    struct temp_sensor *sensor = &sensors[zone->sensor];
+    int32_t distance = labs((int32_t) sensor->temp - zone->target_temp);
+    uint16_t rate = abs(sensor->rate);
+
+    if (zone->heating_enabled)
+    {
+        int32_t heat = labs((int32_t) sensor->temp -
+                (zone->target_temp - zone->deadband));
+
+        if (heat < distance)
+            distance = heat;
+    }
+
+    if (distance < ADAPTIVE_NEAR_BAND)
+        return 0;
+
+    if (rate == 0 || distance > UINT16_MAX)
+        return UINT32_MAX;
+
+    return (uint32_t) distance * 60000 / ((uint32_t) rate * ADAPTIVE_SAMPLES);
+}
+
+/* Shorten the sample interval at once when a zone temperature moves
+   towards a switching point, stretch it by a quarter per sample when
+   things are calm. */
+static void update_sample_interval(void)
+{
+    uint32_t interval = adaptive_ceiling;
+    uint32_t stretched = sample_interval + sample_interval / 4;
+    uint32_t now = tick_get();
+    uint8_t i, z;
+
+    for (z = 0; z < MAX_ZONES; z++)
+    {
+        uint32_t period;
+
+        if (zones[z].state == STOPPED || zones[z].sensor >= num_sensors ||
+                !sensors[zones[z].sensor].online)
+            continue;
+
+        period = zone_sample_period(z);
+        if (period < interval)
+            interval = period;
+    }
+
+    if (interval > stretched)
+        interval = stretched;
+
+    if (interval > adaptive_ceiling)
+        interval = adaptive_ceiling;
+
+    if (interval < sample_period)
+        interval = sample_period;
+
+    if (interval < sample_interval && pipelined)
+    {
+        // pull in conversions scheduled for the longer interval
+        for (i = 0; i < num_sensors; i++)
+        {
+            if ((int32_t) (next_start[i] - now) > (int32_t) (interval / TICK_MS))
+                next_start[i] = now +
+                    ((uint32_t) interval * i / num_sensors) / TICK_MS;
+        }
+    }
+
+    sample_interval = interval;
+}
+
+bool temp_control_update(void)
+{
+    bool new_temps = false;
+    bool changed = false;
+    uint8_t z;
+
+    // let the pending 1-Wire transfer finish in the background
+    if (DS18X20_async_poll() == DS18X20_BUSY)
+        return false;
+
+    if (scan_pending)
+        changed = rescan_result();
+
+    if (swap_a != NO_SENSOR)
+        swap_sensors();
+
+    if (pipelined != pipelined_request)
+    {
+        pipelined = pipelined_request;
+
+        if (pipelined)
+        {
+            start_pipeline();
+        }
+        else
+        {
+            conversion_time = tick_get() - sample_interval / TICK_MS;
+            sample_state = SAMPLE_IDLE;
+        }
+    }
+
+    if (num_sensors > 0)
+    {
+        if (pipelined)
+            new_temps = update_pipelined();
+        else
+            new_temps = update_broadcast();
+    }
+
+    if (new_temps && adaptive)
+        update_sample_interval();
+
+    for (z = 0; z < MAX_ZONES; z++)
+    {
+        if (new_temps)
+        {
+            update_trend(z);
+            update_pid(z);
+            update_control_output(z);
+        }
+
+        update_output_window(z);
+    }
+
+    release_outputs();
+
+    // search in the gaps between samples, a broadcast conversion status
+    // can't be polled after other bus traffic
+    if (ow_async_poll() != OW_ASYNC_BUSY &&
+            (pipelined || sample_state == SAMPLE_IDLE))
+        changed |= rescan_step();
+
+    return new_temps || changed;
+}
+
+void temp_control_set_target_temp(uint8_t zone, int16_t temp)
+{
+    if (zone >= MAX_ZONES)
+        return;
+
+    zones[zone].target_temp = temp;
+    update_control_output(zone);
+}
+
+int16_t temp_control_get_target_temp(uint8_t zone)
+{
+    return zones[zone].target_temp;
+}
+
+// keep the setpoint of a zone in eeprom, profiles change it without saving
+void temp_control_save_target_temp(uint8_t zone)
+{
+    settings.zones[zone].target_temp = zones[zone].target_temp;
+    settings_save();
+}
+
+// bind a zone to a sensor, several zones may share one
+bool temp_control_set_target_sensor(uint8_t zone, uint8_t sensor)
+{
+    if (zone >= MAX_ZONES || sensor >= num_sensors)
+        return false;
+
+    if (sensor != zones[zone].sensor)
+    {
+        zones[zone].sensor = sensor;
+        reset_trend(&zones[zone]);
+        alarm_cycles = ALARM_REFRESH_CYCLES;
+        save_sensor_table();
+    }
+
+    update_control_output(zone);
+
+    return true;
+}
+
+uint8_t temp_control_get_target_sensor(uint8_t zone)
+{
+    return zones[zone].sensor;
+}
+
+// first zone controlled by the sensor, NO_ZONE if none
+uint8_t temp_control_get_sensor_zone(uint8_t sensor)
+{
+    uint8_t z;
+
+    for (z = 0; z < MAX_ZONES; z++)
+    {
+        if (zones[z].sensor == sensor)
+            return z;
+    }
+
+    return NO_ZONE;
+}
+
+/* Assign the cooling and heating channels of a zone (OUTPUT_NONE if
+   unused). A channel belongs to one zone and is only interlocked with
+   the other channel of that zone. */
+bool temp_control_set_zone_outputs(uint8_t zone, output_channel_t cool,
+        output_channel_t heat)
+{
+    struct temp_zone *z;
+
+    if (zone >= MAX_ZONES || !valid_outputs(zone, cool, heat) ||
+            !valid_period(cool, zones[zone].output_period))
+        return false;
+
+    z = &zones[zone];
+
+    if (cool != z->cool_output || heat != z->heat_output)
+    {
+        // release the old channels, see release_outputs()
+        outputs_off(z);
+
+        if (tuning(zone))
+            tune.state = AUTOTUNE_FAILED;
+
+        z->cool_output = cool;
+        z->heat_output = heat;
+        update_output_groups();
+
+        settings.zones[zone].cool_output = cool;
+        settings.zones[zone].heat_output = heat;
+        settings_save();
+    }
+
+    update_control_output(zone);
+
+    return true;
+}
+
+void temp_control_get_zone_outputs(uint8_t zone, output_channel_t *cool,
+        output_channel_t *heat)
+{
+    *cool = zones[zone].cool_output;
+    *heat = zones[zone].heat_output;
+}
+
+void temp_control_set_running(uint8_t zone, bool running)
+{
+    struct temp_zone *z;
+
+    if (zone >= MAX_ZONES)
+        return;
+
+    z = &zones[zone];
+
+    if (running)
+    {
+        if (z->state == STOPPED)
+            z->state = IDLE;
+    }
+    else
+    {
+        z->state = STOPPED;
+    }
+
+    update_control_output(zone);
+}
+
+temp_control_state_t temp_control_get_state(uint8_t zone)
+{
+    return zones[zone].state;
+}
+
+uint8_t temp_control_get_num_sensors(void)
+{
+    return num_sensors;
+}
+
+struct temp_sensor * temp_control_get_sensor_data(uint8_t sensor)
+{
+    if (sensor < num_sensors)
+        return &sensors[sensor];
+
+    return NULL;
+}
+
+/* set conversion resolution (9 to 12 bits), written to the sensor once
+   the bus is idle */
+bool temp_control_set_resolution(uint8_t sensor, uint8_t bits)
+{
+    if (sensor >= num_sensors || bits < 9 || bits > 12 ||
+            !DS18X20_resolution_supported(sensors[sensor].id))
+        return false;
+
+    sensors[sensor].resolution = bits;
+    resolution_pending |= SENSOR_BIT(sensor);
+
+    return true;
+}
+
+// sample period in ms, never shorter than the slowest conversion
+bool temp_control_set_sample_period(uint16_t period)
+{
+    if (period < MIN_SAMPLE_PERIOD)
+        return false;
+
+    sample_period = period;
+
+    if (sample_period < conversion_wait)
+        sample_period = conversion_wait;
+
+    // the adaptive interval starts over from the new minimum
+    sample_interval = sample_period;
+
+    return true;
+}
+
+uint16_t temp_control_get_sample_period(void)
+{
+    return sample_period;
+}
+
+/* With adaptive sampling the sample period is the minimum, the interval
+   grows up to ceiling ms while the zones are stable. The ceiling is
+   ignored when disabling. */
+bool temp_control_set_adaptive(bool enable, uint16_t ceiling)
+{
+    if (enable)
+    {
+        if (ceiling < sample_period || ceiling > MAX_SAMPLE_PERIOD)
+            return false;
+
+        adaptive_ceiling = ceiling;
+    }
+
+    adaptive = enable;
+    sample_interval = sample_period;
+
+    return true;
+}
+
+bool temp_control_get_adaptive(uint16_t *ceiling)
+{
+    *ceiling = adaptive_ceiling;
+
+    return adaptive;
+}
+
+// sample period currently in use in ms
+uint16_t temp_control_get_sample_interval(void)
+{
+    return sample_interval;
+}
+
+/* moving average factor in 1/256 (256 passes the median unchanged) and
+   the largest change between two readings accepted at once */
+bool temp_control_set_filter(uint16_t alpha, int16_t max_jump)
+{
+    if (alpha == 0 || alpha > 256 || max_jump <= 0)
+        return false;
+
+    filter_alpha = alpha;
+    filter_max_jump = max_jump;
+
+    return true;
+}
+
+uint16_t temp_control_get_filter(int16_t *max_jump)
+{
+    *max_jump = filter_max_jump;
+
+    return filter_alpha;
+}
+
+struct sensor_stats * temp_control_get_stats(uint8_t sensor)
+{
+    return &stats[sensor];
+}
+
+// restart the statistics of a sensor, NO_SENSOR restarts all of them
+bool temp_control_reset_stats(uint8_t sensor)
+{
+    uint8_t i;
+
+    if (sensor == NO_SENSOR)
+    {
+        for (i = 0; i < num_sensors; i++)
+            stats_reset(&stats[i]);
+
+        return true;
+    }
+
+    if (sensor >= num_sensors)
+        return false;
+
+    stats_reset(&stats[sensor]);
+
+    return true;
+}
+
+// the window length in s, the statistics of all sensors restart
+bool temp_control_set_stats_window(uint8_t window, uint32_t length)
+{
+    if (!stats_set_window(window, length))
+        return false;
+
+    return temp_control_reset_stats(NO_SENSOR);
+}
+
+// switch between one broadcast conversion and staggered per-sensor ones
+void temp_control_set_pipelined(bool enable)
+{
+    pipelined_request = enable;
+}
+
+bool temp_control_get_pipelined(void)
+{
+    return pipelined_request;
+}
+
+/* In broadcast mode only read the zone sensors and the sensors that
+   moved more than band degrees since their last reading. */
+bool temp_control_set_alarm_monitor(bool enable, uint8_t band)
+{
+    if (band == 0 || band > MAX_ALARM_BAND)
+        return false;
+
+    alarm_monitor = enable;
+    alarm_band = band;
+    // start with a full read, which programs every band
+    alarm_cycles = ALARM_REFRESH_CYCLES;
+
+    return true;
+}
+
+bool temp_control_get_alarm_monitor(void)
+{
+    return alarm_monitor;
+}
+
+bool temp_control_set_sensor_name(uint8_t sensor, const char *name,
+        uint8_t len)
+{
+    if (sensor >= num_sensors || len >= SENSOR_NAME_SIZE)
+        return false;
+
+    memcpy(sensors[sensor].name, name, len);
+    sensors[sensor].name[len] = '\0';
+    save_sensor_table();
+
+    return true;
+}
+
+/* exchange two slots of the sensor table, which moves the sensors between
+   roles (zone sensor slots, display order) */
+bool temp_control_swap_sensors(uint8_t a, uint8_t b)
+{
+    if (a >= num_sensors || b >= num_sensors || a == b)
+        return false;
+
+    // applied by temp_control_update() once no transfer targets the slots
+    swap_a = a;
+    swap_b = b;
+
+    return true;
+}
+
+bool temp_control_set_mode(uint8_t zone, temp_control_mode_t mode)
+{
+    struct temp_zone *z;
+
+    if (zone >= MAX_ZONES || (mode != CONTROL_BANG_BANG && mode != CONTROL_PID))
+        return false;
+
+    z = &zones[zone];
+
+    if (mode != z->mode)
+    {
+        z->mode = mode;
+        z->output = 0;
+        pid_reset(&z->pid);
+        outputs_off(z);
+
+        settings.zones[zone].control_mode = mode;
+        settings_save();
+    }
+
+    update_control_output(zone);
+
+    return true;
+}
+
+temp_control_mode_t temp_control_get_mode(uint8_t zone)
+{
+    return zones[zone].mode;
+}
+
+// pid gains and output period in s (0: proportional output, not with a
+// relay for cooling), kept in eeprom
+bool temp_control_set_pid(uint8_t zone, const pid_gains_t *gains,
+        uint16_t period)
+{
+    if (zone >= MAX_ZONES || gains->kp < 0 || gains->ki < 0 || gains->kd < 0 ||
+            !valid_period(zones[zone].cool_output, period))
+        return false;
+
+    // keeps the integral output, a bumpless change of the gains
+    pid_set_gains(&zones[zone].pid, gains);
+    zones[zone].output_period = period;
+
+    settings.zones[zone].pid_gains = *gains;
+    settings.zones[zone].output_period = period;
+    settings_save();
+
+    return true;
+}
+
+void temp_control_get_pid(uint8_t zone, pid_gains_t *gains, uint16_t *period)
+{
+    *gains = zones[zone].pid.gains;
+    *period = zones[zone].output_period;
+}
+
+// last pid output in percent
+int16_t temp_control_get_output(uint8_t zone)
+{
+    return zones[zone].output;
+}
+
+// cpu cycles spent in the last pid update
+uint16_t temp_control_get_pid_cycles(uint8_t zone)
+{
+    return zones[zone].pid_cycles;
+}
+
+/* Start a relay autotune of one zone around its target temperature, the
+   resulting gains are stored and pid mode is enabled once AUTOTUNE_CYCLES
+   oscillations were measured. Only one zone is tuned at a time. */
+bool temp_control_start_autotune(uint8_t zone, int16_t hysteresis)
+{
+    struct temp_zone *z;
+
+    if (zone >= MAX_ZONES || tune.state == AUTOTUNE_RUNNING)
+        return false;
+
+    z = &zones[zone];
+
+    if (z->state == STOPPED || z->sensor >= num_sensors ||
+            !sensors[z->sensor].online || z->cool_output == OUTPUT_NONE ||
+            hysteresis <= 0 || hysteresis > MAX_AUTOTUNE_HYSTERESIS)
+        return false;
+
+    memset(&tune, 0, sizeof(tune));
+    tune.state = AUTOTUNE_RUNNING;
+    tune.zone = zone;
+    tune_hysteresis = hysteresis;
+    tune_relay_on = (sensors[z->sensor].temp > z->target_temp);
+    tune_switch_ons = 0;
+    tune_max = INT16_MIN;
+    tune_min = INT16_MAX;
+    tune_start = tick_get();
+    tune_period_sum = 0;
+    tune_amplitude_sum = 0;
+
+    update_control_output(zone);
+
+    return true;
+}
+
+void temp_control_stop_autotune(void)
+{
+    if (tune.state == AUTOTUNE_RUNNING)
+    {
+        tune.state = AUTOTUNE_OFF;
+        set_cooling(&zones[tune.zone], false);
+        update_control_output(tune.zone);
+    }
+}
+
+const struct autotune * temp_control_get_autotune(void)
+{
+    return &tune;
+}
+
+// fan speed at full cooling, 0 for fixed duty cycles, kept in eeprom
+void temp_control_set_fan_rpm(uint16_t rpm)
+{
+    fan_control_set_on_rpm(rpm);
+
+    settings.fan_on_rpm = rpm;
+    settings_save();
+
+    update_all_outputs();
+}
+
+/* enable the heating output of a zone, it is switched on below
+   target_temp - band (on/off) or by negative pid outputs */
+bool temp_control_set_heating(uint8_t zone, bool enable, int16_t band)
+{
+    struct temp_zone *z;
+
+    if (zone >= MAX_ZONES || band < MIN_DEADBAND || band > MAX_DEADBAND)
+        return false;
+
+    z = &zones[zone];
+    z->heating_enabled = enable;
+    z->deadband = band;
+    update_pid_range(z);
+
+    if (!enable)
+        set_heater(z, 0);
+
+    settings.zones[zone].heating_enabled = enable;
+    settings.zones[zone].deadband = band;
+    settings_save();
+
+    update_control_output(zone);
+
+    return true;
+}
+
+bool temp_control_get_heating(uint8_t zone, int16_t *band)
+{
+    *band = zones[zone].deadband;
+
+    return zones[zone].heating_enabled;
+}
+
+/* Switch the on/off outputs of a zone off early when the temperature
+   predicted lag seconds ahead crosses the threshold. The lag is learned
+   from the drift after switching off, lag sets the starting value. */
+bool temp_control_set_predictor(uint8_t zone, bool enable, uint16_t lag)
+{
+    if (zone >= MAX_ZONES || lag > MAX_PREDICT_LAG)
+        return false;
+
+    zones[zone].predict = enable;
+    zones[zone].lag = lag;
+
+    settings.zones[zone].predict = enable;
+    settings.zones[zone].predict_lag = lag;
+    settings_save();
+
+    update_control_output(zone);
+
+    return true;
+}
+
+bool temp_control_get_predictor(uint8_t zone, uint16_t *lag, int16_t *slope,
+        int16_t *predicted)
+{
+    struct temp_zone *z = &zones[zone];
+
+    *lag = z->lag;
+    *slope = z->slope;
+    *predicted = (z->sensor < num_sensors) ?
+        predict_temp(z, sensors[z->sensor].temp) : 0;
+
+    return z->predict;
+}
+
+// minimum on/off times and cycle limit of an actuator, kept in eeprom
+bool temp_control_set_output_limits(output_channel_t channel,
+        const output_limits_t *limits)
+{
+    if (!output_set_limits(channel, limits))
+        return false;
+
+    settings.output_limits[channel] = *limits;
+    settings_save();
+
+    return true;
+}
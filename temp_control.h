@@ -4,16 +4,95 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "onewire.h"
+#include "pid.h"
+#include "output.h"
+#include "stats.h"
 
 #define MAX_TEMP_SENSORS 10
+#define SENSOR_NAME_SIZE 11
+
+// independent control loops, each with its own sensor and outputs
+#define MAX_ZONES 4
+#define NO_ZONE 0xFF
+#define NO_SENSOR 0xFF
+
+// sample period limits in ms
+#define MIN_SAMPLE_PERIOD 100
+#define DEFAULT_SAMPLE_PERIOD 5000
+#define MAX_SAMPLE_PERIOD 60000
+
+// adaptive sampling: the sample period is stretched up to a ceiling while
+// the zone temperatures are far from a switching point or change slowly
+#define DEFAULT_ADAPTIVE_CEILING 30000
+
+// alarm monitoring band in degrees
+#define DEFAULT_ALARM_BAND 1
+#define MAX_ALARM_BAND 20
+
+// time proportioning window of the pid output in s, 0 sets the cooling level
+// in proportion to the output instead
+#define MIN_OUTPUT_PERIOD 10
+#define MAX_OUTPUT_PERIOD 600
+#define DEFAULT_OUTPUT_PERIOD 60
+
+// gap between cooling and heating in the on/off mode, in the pid mode
+// errors within half of it are ignored
+#define MIN_DEADBAND FLOAT_TO_FIX(0.5)
+#define MAX_DEADBAND INT_TO_FIX(5)
+#define DEFAULT_DEADBAND INT_TO_FIX(1)
+
+// number of measured oscillations and maximum relay hysteresis
+#define AUTOTUNE_CYCLES 4
+#define MAX_AUTOTUNE_HYSTERESIS INT_TO_FIX(2)
+
+// reading filter: smoothing factor of the moving average in 1/256 (256 =
+// off) and the largest plausible change between two readings
+#define DEFAULT_FILTER_ALPHA 64
+#define DEFAULT_FILTER_JUMP INT_TO_FIX(5)
+
+// lag of the on/off outputs used to predict the temperature, in s
+#define MAX_PREDICT_LAG 1800
+
+// interval between background searches for added or removed sensors in ms
+#define RESCAN_PERIOD 10000
 
 struct temp_sensor
 {   
     uint8_t id[OW_ROMCODE_SIZE];
-    char name[11];
-    int16_t temp;
-    int16_t min;
-    int16_t max;
+    uint8_t bus;
+    uint8_t resolution;     // bits, 9 to 12
+    bool online;            // found by the last search
+    char name[SENSOR_NAME_SIZE];
+    int16_t raw;            // last reading as read
+    int16_t temp;           // filtered
+    uint16_t rejects;       // readings dropped by the filter
+    int16_t rate;           // fixed point degrees per minute
+    uint32_t sample_tick;   // tick of the last valid reading
+};
+
+typedef enum temp_control_mode_t
+{
+    CONTROL_BANG_BANG,
+    CONTROL_PID,
+} temp_control_mode_t;
+
+typedef enum autotune_state_t
+{
+    AUTOTUNE_OFF,
+    AUTOTUNE_RUNNING,
+    AUTOTUNE_DONE,
+    AUTOTUNE_FAILED,
+} autotune_state_t;
+
+struct autotune
+{
+    autotune_state_t state;
+    uint8_t zone;
+    uint8_t cycles;         // oscillations measured so far
+    uint16_t period;        // ultimate period in s
+    int16_t amplitude;      // half of peak to peak
+    int16_t ku;             // ultimate gain, percent per degree
+    pid_gains_t gains;
 };
 
 typedef enum temp_control_state_t
@@ -26,12 +105,55 @@ typedef enum temp_control_state_t
 
 void temp_control_init(void);
 bool temp_control_update(void);
-void temp_control_set_target_temp(int16_t temp);
-int16_t temp_control_get_target_temp(void);
-void temp_control_set_target_sensor(uint8_t sensor);
-void temp_control_set_running(bool running);
-temp_control_state_t temp_control_get_state(void);
+void temp_control_set_target_temp(uint8_t zone, int16_t temp);
+int16_t temp_control_get_target_temp(uint8_t zone);
+void temp_control_save_target_temp(uint8_t zone);
+bool temp_control_set_target_sensor(uint8_t zone, uint8_t sensor);
+void temp_control_set_running(uint8_t zone, bool running);
+temp_control_state_t temp_control_get_state(uint8_t zone);
 uint8_t temp_control_get_num_sensors(void);
 struct temp_sensor * temp_control_get_sensor_data(uint8_t sensor);
+bool temp_control_set_resolution(uint8_t sensor, uint8_t bits);
+bool temp_control_set_sensor_name(uint8_t sensor, const char *name,
+        uint8_t len);
+bool temp_control_swap_sensors(uint8_t a, uint8_t b);
+uint8_t temp_control_get_target_sensor(uint8_t zone);
+uint8_t temp_control_get_sensor_zone(uint8_t sensor);
+bool temp_control_set_zone_outputs(uint8_t zone, output_channel_t cool,
+        output_channel_t heat);
+void temp_control_get_zone_outputs(uint8_t zone, output_channel_t *cool,
+        output_channel_t *heat);
+bool temp_control_set_sample_period(uint16_t period);
+uint16_t temp_control_get_sample_period(void);
+bool temp_control_set_adaptive(bool enable, uint16_t ceiling);
+bool temp_control_get_adaptive(uint16_t *ceiling);
+uint16_t temp_control_get_sample_interval(void);
+bool temp_control_set_filter(uint16_t alpha, int16_t max_jump);
+uint16_t temp_control_get_filter(int16_t *max_jump);
+struct sensor_stats * temp_control_get_stats(uint8_t sensor);
+bool temp_control_reset_stats(uint8_t sensor);
+bool temp_control_set_stats_window(uint8_t window, uint32_t length);
+void temp_control_set_pipelined(bool enable);
+bool temp_control_get_pipelined(void);
+bool temp_control_set_alarm_monitor(bool enable, uint8_t band);
+bool temp_control_get_alarm_monitor(void);
+bool temp_control_set_mode(uint8_t zone, temp_control_mode_t mode);
+temp_control_mode_t temp_control_get_mode(uint8_t zone);
+bool temp_control_set_pid(uint8_t zone, const pid_gains_t *gains,
+        uint16_t period);
+void temp_control_get_pid(uint8_t zone, pid_gains_t *gains, uint16_t *period);
+int16_t temp_control_get_output(uint8_t zone);
+uint16_t temp_control_get_pid_cycles(uint8_t zone);
+bool temp_control_start_autotune(uint8_t zone, int16_t hysteresis);
+void temp_control_stop_autotune(void);
+const struct autotune * temp_control_get_autotune(void);
+void temp_control_set_fan_rpm(uint16_t rpm);
+bool temp_control_set_heating(uint8_t zone, bool enable, int16_t band);
+bool temp_control_get_heating(uint8_t zone, int16_t *band);
+bool temp_control_set_predictor(uint8_t zone, bool enable, uint16_t lag);
+bool temp_control_get_predictor(uint8_t zone, uint16_t *lag, int16_t *slope,
+        int16_t *predicted);
+bool temp_control_set_output_limits(output_channel_t channel,
+        const output_limits_t *limits);
 
 #endif /* _TEMP_CONTROL_H_ */
@@ -46,3 +46,28 @@ uint32_t tick_get(void)
 
     return val;
 }
+
+// timer count within the current tick, start of a cycle measurement
+uint16_t tick_get_clocks(void)
+{
+    return TCNT3;
+}
+
+/* cpu cycles since tick_get_clocks() returned start, the measured code
+   has to finish within one tick */
+uint32_t tick_cycles_since(uint16_t start)
+{
+    uint16_t now = TCNT3;
+    uint32_t clocks;
+
+    if (now >= start)
+        clocks = now - start;
+    else
+        clocks = now + CLOCKS_PER_TICK - start;
+
+#ifdef PRESCALE_8
+    return clocks * 8;
+#else
+    return clocks;
+#endif
+}
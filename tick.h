@@ -7,5 +7,7 @@
 
 void tick_init(void);
 uint32_t tick_get(void);
+uint16_t tick_get_clocks(void);
+uint32_t tick_cycles_since(uint16_t start);
 
 #endif /* _TICK_H_ */
@@ -1,139 +1,425 @@
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
-#include <util/atomic.h>
+#include "uart.h"
+#include "onewire.h"
 
-#define BAUD_TOL 2
-#define BAUD 115200
-#include <util/setbaud.h>
+// largest accepted baud rate error in 1/1000
+#define BAUD_TOL 20
 
-#define BUFSIZE 1024
+// rates offered for negotiation, only those within tolerance are usable
+static const uint32_t baud_rates[] = {
+    9600, 19200, 38400, 57600, 115200, 230400, 250000, 500000, 625000,
+    1250000,
+};
 
-static uint8_t rx_buf[BUFSIZE];
-static volatile uint16_t rx_head = 0;
-static volatile uint16_t rx_tail = 0;
+#if UART_USE_USART1 && OW_USE_USART
+#error "USART1 can't be a uart channel and the onewire master at once"
+#endif
 
-static uint8_t tx_buf[BUFSIZE];
-static volatile uint16_t tx_head = 0;
-static volatile uint16_t tx_tail = 0;
+#if (UART0_RX_SIZE & (UART0_RX_SIZE - 1)) || \
+    (UART0_TX_SIZE & (UART0_TX_SIZE - 1))
+#error "UART0_RX_SIZE and UART0_TX_SIZE must be powers of two"
+#endif
 
-ISR(USART0_RX_vect)
+#if UART_USE_USART1 && ((UART1_RX_SIZE & (UART1_RX_SIZE - 1)) || \
+    (UART1_TX_SIZE & (UART1_TX_SIZE - 1)))
+#error "UART1_RX_SIZE and UART1_TX_SIZE must be powers of two"
+#endif
+
+/* Single producer, single consumer rings: each index has one writer.
+   An isr can't be interrupted by the main loop, so the indices it writes
+   are read twice in the main loop until both reads agree. The indices the
+   main loop writes are published through two copies, the idle copy is
+   written first and then the 8 bit selector is switched. */
+struct published_index
 {
-    uint16_t head = rx_head;
-    uint16_t tail = rx_tail;
+    volatile uint16_t copy[2];
+    volatile uint8_t sel;
+};
+
+/* The USARTs have the same register layout, the bits are addressed with
+   the USART0 names. */
+struct uart_channel
+{
+    volatile uint8_t *ucsra;
+    volatile uint8_t *ucsrb;
+    volatile uint8_t *ucsrc;
+    volatile uint16_t *ubrr;
+    volatile uint8_t *udr;
+
+    uint8_t *rx_buf;
+    uint16_t rx_mask;
+    volatile uint16_t rx_head;      // written by the isr
+    struct published_index rx_tail;
+
+    uint8_t *tx_buf;
+    uint16_t tx_mask;
+    struct published_index tx_head;
+    volatile uint16_t tx_tail;      // written by the isr
 
-    while (bit_is_set(UCSR0A, RXC0))
+    uint16_t tx_full;               // writes refused for lack of space
+    uint32_t baud;
+};
+
+static uint8_t rx_buf0[UART0_RX_SIZE];
+static uint8_t tx_buf0[UART0_TX_SIZE];
+#if UART_USE_USART1
+static uint8_t rx_buf1[UART1_RX_SIZE];
+static uint8_t tx_buf1[UART1_TX_SIZE];
+#endif
+
+static struct uart_channel channels[UART_NUM_CHANNELS] = {
+    {
+        .ucsra = &UCSR0A, .ucsrb = &UCSR0B, .ucsrc = &UCSR0C,
+        .ubrr = &UBRR0, .udr = &UDR0,
+        .rx_buf = rx_buf0, .rx_mask = UART0_RX_SIZE - 1,
+        .tx_buf = tx_buf0, .tx_mask = UART0_TX_SIZE - 1,
+    },
+#if UART_USE_USART1
     {
-        uint8_t data = UDR0;
+        .ucsra = &UCSR1A, .ucsrb = &UCSR1B, .ucsrc = &UCSR1C,
+        .ubrr = &UBRR1, .udr = &UDR1,
+        .rx_buf = rx_buf1, .rx_mask = UART1_RX_SIZE - 1,
+        .tx_buf = tx_buf1, .tx_mask = UART1_TX_SIZE - 1,
+    },
+#endif
+};
+
+static void publish(struct published_index *index, uint16_t value)
+{
+    uint8_t sel = index->sel ^ 1;
 
-        if (((head + 1) % BUFSIZE) != tail)
+    index->copy[sel] = value;
+    index->sel = sel;
+}
+
+// value of a main loop index, also safe in the isr
+static uint16_t published(const struct published_index *index)
+{
+    return index->copy[index->sel];
+}
+
+// value of an isr index from the main loop
+static uint16_t isr_index(const volatile uint16_t *index)
+{
+    uint16_t a, b;
+
+    do
+    {
+        a = *index;
+        b = *index;
+    }
+    while (a != b);
+
+    return a;
+}
+
+static inline void rx_isr(struct uart_channel *c)
+{
+    uint16_t head = c->rx_head;
+    uint16_t tail = published(&c->rx_tail);
+
+    while (bit_is_set(*c->ucsra, RXC0))
+    {
+        uint8_t data = *c->udr;
+
+        if (((head + 1) & c->rx_mask) != tail)
         {
-            rx_buf[head] = data;
-            head = (head + 1) % BUFSIZE;
+            c->rx_buf[head] = data;
+            head = (head + 1) & c->rx_mask;
         }
     }
 
-    rx_head = head;
+    c->rx_head = head;
 }
 
-ISR(USART0_UDRE_vect)
+static inline void udre_isr(struct uart_channel *c)
 {
-    uint16_t head = tx_head;
-    uint16_t tail = tx_tail;
+    uint16_t head = published(&c->tx_head);
+    uint16_t tail = c->tx_tail;
 
-    while (bit_is_set(UCSR0A, UDRE0))
+    while (bit_is_set(*c->ucsra, UDRE0))
     {
         if (head != tail)
         {
-            UDR0 = tx_buf[tail];
-            tail = (tail + 1) % BUFSIZE;
+            // clear TXC0, it flags the end of the last byte
+            *c->ucsra = (*c->ucsra & (_BV(U2X0) | _BV(MPCM0))) | _BV(TXC0);
+            *c->udr = c->tx_buf[tail];
+            tail = (tail + 1) & c->tx_mask;
         }
         else
         {
-            UCSR0B &= ~_BV(UDRIE0);
+            *c->ucsrb &= ~_BV(UDRIE0);
             break;
         }
     }
 
-    tx_tail = tail;
+    c->tx_tail = tail;
 }
 
-void uart_init(void)
+ISR(USART0_RX_vect)
 {
-    UBRR0 = UBRR_VALUE;
-#if USE_2X
-    UCSR0A = U2X0;
-#else
-    UCSR0A = 0;
-#endif
-    UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
-    UCSR0B = _BV(RXCIE0) | _BV(RXEN0) | _BV(TXEN0);
+    rx_isr(&channels[UART_CHANNEL_0]);
+}
+
+ISR(USART0_UDRE_vect)
+{
+    udre_isr(&channels[UART_CHANNEL_0]);
+}
+
+#if UART_USE_USART1
+ISR(USART1_RX_vect)
+{
+    rx_isr(&channels[UART_CHANNEL_1]);
+}
+
+ISR(USART1_UDRE_vect)
+{
+    udre_isr(&channels[UART_CHANNEL_1]);
 }
+#endif
 
-void uart_putc(uint8_t data)
+/* Divisor for a rate with 16 or, failing that, 8 samples per bit, false
+   if neither is within BAUD_TOL at F_CPU. */
+static bool baud_divisor(uint32_t rate, uint16_t *ubrr, bool *u2x)
 {
-    uint16_t head = tx_head;
+    uint8_t samples;
 
-    NONATOMIC_BLOCK(NONATOMIC_RESTORESTATE)
+    for (samples = 16; samples >= 8; samples -= 8)
     {
-        uint16_t tail;
+        uint32_t div = (F_CPU + rate * samples / 2) / (rate * samples);
+        uint32_t actual;
+
+        if (div == 0 || div > 4096)
+            continue;
 
-        do
+        actual = F_CPU / (samples * div);
+
+        if (labs((int32_t) (actual - rate)) * 1000 / rate <= BAUD_TOL)
         {
-            ATOMIC_BLOCK(ATOMIC_FORCEON)
-            {
-                tail = tx_tail;
-            }
+            *ubrr = div - 1;
+            *u2x = (samples == 8);
+            return true;
         }
-        while (((head + 1) % BUFSIZE) == tail);
     }
 
-    tx_buf[head] = data;
+    return false;
+}
+
+void uart_init(uart_channel_t ch)
+{
+    struct uart_channel *c = &channels[ch];
+
+    *c->ucsrc = _BV(UCSZ01) | _BV(UCSZ00);
+    uart_set_baud(ch, UART_DEFAULT_BAUD);
+    *c->ucsrb = _BV(RXCIE0) | _BV(RXEN0) | _BV(TXEN0);
+}
+
+// the rate is in the table and within tolerance
+bool uart_baud_valid(uint32_t rate)
+{
+    uint16_t ubrr;
+    bool u2x;
+    uint8_t i;
 
-    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    for (i = 0; i < sizeof(baud_rates) / sizeof(baud_rates[0]); i++)
     {
-        tx_head = (head + 1) % BUFSIZE;
-        UCSR0B |= _BV(UDRIE0);
+        if (baud_rates[i] == rate)
+            return baud_divisor(rate, &ubrr, &u2x);
     }
+
+    return false;
 }
 
-uint8_t uart_getc(void)
+/* switch the rate at once, bytes still on the line are garbled, see
+   uart_tx_idle() */
+bool uart_set_baud(uart_channel_t ch, uint32_t rate)
 {
-    uint16_t tail = rx_tail;
-    uint8_t data;
+    struct uart_channel *c = &channels[ch];
+    uint16_t ubrr;
+    bool u2x;
 
-    NONATOMIC_BLOCK(NONATOMIC_RESTORESTATE)
+    if (!uart_baud_valid(rate))
+        return false;
+
+    baud_divisor(rate, &ubrr, &u2x);
+    *c->ubrr = ubrr;
+    *c->ucsra = u2x ? _BV(U2X0) : 0;
+    c->baud = rate;
+
+    return true;
+}
+
+uint32_t uart_get_baud(uart_channel_t ch)
+{
+    return channels[ch].baud;
+}
+
+// the n-th usable rate, 0 past the last one
+uint32_t uart_get_baud_rate(uint8_t n)
+{
+    uint8_t i;
+
+    for (i = 0; i < sizeof(baud_rates) / sizeof(baud_rates[0]); i++)
     {
-        uint16_t head;
+        if (uart_baud_valid(baud_rates[i]) && n-- == 0)
+            return baud_rates[i];
+    }
 
-        do
-        {
-            ATOMIC_BLOCK(ATOMIC_FORCEON)
-            {
-                head = rx_head;
-            }
-        }
-        while (head == tail);
+    return 0;
+}
+
+// everything queued has left the shift register
+bool uart_tx_idle(uart_channel_t ch)
+{
+    struct uart_channel *c = &channels[ch];
+
+    return isr_index(&c->tx_tail) == published(&c->tx_head) &&
+        bit_is_set(*c->ucsra, TXC0);
+}
+
+/* contiguous received bytes at the read position, they stay in the ring
+   until uart_rx_commit() */
+uint16_t uart_rx_peek(uart_channel_t ch, const uint8_t **data)
+{
+    struct uart_channel *c = &channels[ch];
+    uint16_t head = isr_index(&c->rx_head);
+    uint16_t tail = published(&c->rx_tail);
+
+    *data = &c->rx_buf[tail];
+
+    return (head >= tail) ? head - tail : c->rx_mask + 1 - tail;
+}
+
+void uart_rx_commit(uart_channel_t ch, uint16_t len)
+{
+    struct uart_channel *c = &channels[ch];
+
+    publish(&c->rx_tail, (published(&c->rx_tail) + len) & c->rx_mask);
+}
+
+/* contiguous free space at the write position, written bytes are sent
+   after uart_tx_commit() */
+uint16_t uart_tx_reserve(uart_channel_t ch, uint8_t **data)
+{
+    struct uart_channel *c = &channels[ch];
+    uint16_t head = published(&c->tx_head);
+    uint16_t tail = isr_index(&c->tx_tail);
+
+    *data = &c->tx_buf[head];
+
+    // one slot stays empty to tell a full ring from an empty one
+    if (tail > head)
+        return tail - head - 1;
+
+    return c->tx_mask + 1 - head - (tail == 0);
+}
+
+void uart_tx_commit(uart_channel_t ch, uint16_t len)
+{
+    struct uart_channel *c = &channels[ch];
+
+    publish(&c->tx_head, (published(&c->tx_head) + len) & c->tx_mask);
+
+    // a clear by the isr racing with this only costs an extra interrupt
+    *c->ucsrb |= _BV(UDRIE0);
+}
+
+// waits while the ring is full
+void uart_write(uart_channel_t ch, const uint8_t *data, uint16_t len)
+{
+    while (len > 0)
+    {
+        uint8_t *span;
+        uint16_t n = uart_tx_reserve(ch, &span);
+
+        if (n > len)
+            n = len;
+
+        memcpy(span, data, n);
+        uart_tx_commit(ch, n);
+
+        data += n;
+        len -= n;
     }
+}
 
-    data = rx_buf[tail];
+// free space in the transmit ring
+uint16_t uart_tx_free(uart_channel_t ch)
+{
+    struct uart_channel *c = &channels[ch];
+
+    return (isr_index(&c->tx_tail) - published(&c->tx_head) - 1) &
+        c->tx_mask;
+}
 
-    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+// queues all of data or nothing, without waiting
+bool uart_try_write(uart_channel_t ch, const uint8_t *data, uint16_t len)
+{
+    if (uart_tx_free(ch) < len)
     {
-        rx_tail = (tail + 1) % BUFSIZE;
+        if (channels[ch].tx_full != UINT16_MAX)
+            channels[ch].tx_full++;
+
+        return false;
     }
 
-    return data;
+    uart_write(ch, data, len);
+
+    return true;
+}
+
+uint16_t uart_get_tx_full(uart_channel_t ch)
+{
+    return channels[ch].tx_full;
 }
 
-uint16_t uart_bytes_available(void)
+// returns the number of bytes read, without waiting
+uint16_t uart_read(uart_channel_t ch, uint8_t *data, uint16_t len)
 {
-    uint16_t num_bytes;
+    uint16_t total = 0;
 
-    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    while (total < len)
     {
-        num_bytes = rx_head - rx_tail;
+        const uint8_t *span;
+        uint16_t n = uart_rx_peek(ch, &span);
+
+        if (n == 0)
+            break;
+
+        if (n > len - total)
+            n = len - total;
+
+        memcpy(&data[total], span, n);
+        uart_rx_commit(ch, n);
+        total += n;
     }
 
-    return (num_bytes % BUFSIZE);
+    return total;
+}
+
+void uart_putc(uart_channel_t ch, uint8_t data)
+{
+    uart_write(ch, &data, 1);
+}
+
+// waits for a byte
+uint8_t uart_getc(uart_channel_t ch)
+{
+    uint8_t data;
+
+    while (uart_read(ch, &data, 1) == 0)
+        ;
+
+    return data;
+}
+
+uint16_t uart_bytes_available(uart_channel_t ch)
+{
+    struct uart_channel *c = &channels[ch];
+
+    return (isr_index(&c->rx_head) - published(&c->rx_tail)) & c->rx_mask;
 }
@@ -2,10 +2,46 @@
 #define _UART_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 
-void uart_init(void);
-void uart_putc(uint8_t c);
-uint8_t uart_getc(void);
-uint16_t uart_bytes_available(void);
+// USART1 as a second channel, it can't serve as onewire master meanwhile
+#define UART_USE_USART1 1
+
+// ring sizes per channel, powers of two
+#define UART0_RX_SIZE 1024
+#define UART0_TX_SIZE 1024
+#define UART1_RX_SIZE 64
+#define UART1_TX_SIZE 512
+
+// rate after reset and after a failed negotiation
+#define UART_DEFAULT_BAUD 115200
+
+typedef enum uart_channel_t
+{
+    UART_CHANNEL_0,
+#if UART_USE_USART1
+    UART_CHANNEL_1,
+#endif
+    UART_NUM_CHANNELS,
+} uart_channel_t;
+
+void uart_init(uart_channel_t ch);
+void uart_putc(uart_channel_t ch, uint8_t c);
+uint8_t uart_getc(uart_channel_t ch);
+uint16_t uart_bytes_available(uart_channel_t ch);
+void uart_write(uart_channel_t ch, const uint8_t *data, uint16_t len);
+uint16_t uart_tx_free(uart_channel_t ch);
+bool uart_try_write(uart_channel_t ch, const uint8_t *data, uint16_t len);
+uint16_t uart_get_tx_full(uart_channel_t ch);
+bool uart_baud_valid(uint32_t rate);
+bool uart_set_baud(uart_channel_t ch, uint32_t rate);
+uint32_t uart_get_baud(uart_channel_t ch);
+uint32_t uart_get_baud_rate(uint8_t n);
+bool uart_tx_idle(uart_channel_t ch);
+uint16_t uart_read(uart_channel_t ch, uint8_t *data, uint16_t len);
+uint16_t uart_rx_peek(uart_channel_t ch, const uint8_t **data);
+void uart_rx_commit(uart_channel_t ch, uint16_t len);
+uint16_t uart_tx_reserve(uart_channel_t ch, uint8_t **data);
+void uart_tx_commit(uart_channel_t ch, uint16_t len);
 
 #endif /* _UART_H_ */